@@ -4,6 +4,10 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
 #include <rte_eal.h>
 #include <rte_ethdev.h>
@@ -15,194 +19,508 @@
 #include <rte_ip.h>
 // #include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <rte_common.h>
+#include <rte_pause.h>
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+#include <rte_gso.h>
+#include <rte_ring.h>
+#include <rte_hash_crc.h>
+#ifdef RTE_ARCH_X86
+#include <rte_vect.h>
+#endif
+
+#include "cksum.h"
+#include "rxidle.h"
+#include "pools.h"
+#include "hist.h"
+#include "stats.h"
+#include "probe.h"
+#include "pktio.h"
+#include "tune.h"
+#include "flowrule.h"
+#include "datapath.h"
+#include "flowq.h"
 
 #define CLOCK_MONOTONIC 1
 // #define PKT_TX_IPV4          (1ULL << 55)
 // #define PKT_TX_IP_CKSUM      (1ULL << 54)
 
-#define RX_RING_SIZE 1024
-#define TX_RING_SIZE 1024
+#define PORT_NUM 4
 
-#define NUM_MBUFS 8191
-#define MBUF_CACHE_SIZE 250
-#define BURST_SIZE 32
+#define MAX_FLOWS (1 << 20)
+/* flow id travels in both ports: dst carries the low bits, src the high ones */
+#define FLOW_PORT_BASE 5001
+#define FLOW_PORT_BITS 15
+#define MAX_WIN_SIZE 64 // largest window a server advertises (its -n), sizes the pools
+#define INIT_RWND 8 // smallest one, assumed until the first ack tells
+#define INIT_CWND 10 // RFC 6928
 
-#define MAX_FLOWS 8
-#define MAX_WIN_SIZE 10
+#define DUPACK_THRESH 3
+#define MAX_CWND 1024
+#define RTO_MAX_BACKOFF 6 // the retransmission timer doubles at most this often, 64 x rto
 
+/* DCTCP (RFC 8257) alpha in fixed point, DCTCP_ONE is 1.0, gain g = 1/16 */
+#define DCTCP_SHIFT 10
+#define DCTCP_ONE (1 << DCTCP_SHIFT)
+#define DCTCP_G_SHIFT 4
+
+#define RPC_RING 1024 // requests of a flow that may be outstanding, sizes the issue time ring
+#define RPC_TIMEOUT_MS 10 // a request acked but unanswered this long has lost its response
+#define RPC_DRAIN_MS 100 // wait for the last responses once every flow is acked
+
+
+/* window fields shared between TX and RX lcores, each has a single writer */
+#define LOAD_ACQ(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_REL(x,v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
 
-/* optional Lock*/
-// #define WIN_LOCK
-#ifdef WIN_LOCK
-    #define INIT(l) if (pthread_mutex_init(&l, NULL) != 0) printf("\n mutex init has failed\n")
-    #define LOCK(l) pthread_mutex_lock(&l)
-    #define UNLOCK(l) pthread_mutex_unlock(&l)
-#else
-    #define INIT(l) {}
-    #define LOCK(l) {}
-    #define UNLOCK(l) {}
-#endif
 
 
+#define PREFETCH_OFFSET 4
+#define IP_PROTO IPPROTO_TCP // NICs only segment and checksum real TCP
+#define IP_ADDR RTE_IPV4(127, 0, 0, 1) // both ends, frames are addressed by MAC
+#define TCP_HDR_OFF (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr))
+#define TSO_MAX_SEGS 64 // segments per TSO/GSO super-frame, also the GSO output array
+#define GSO_INDIRECT_MBUFS 4095
 
 #define SET(x,y) x = x | y
 
-int NUM_PING = 100;
+/* LAB1 TCP timestamp option, NOP NOP TS keeps the header 4 bytes aligned */
+#define TCP_OPT_NOP 1
+#define TCP_OPT_TS 8
+#define TCP_OPT_TS_LEN 10
+#define TS_SHIFT 4 // tsval ticks are 16 TSC cycles, wraps after ~20s at 3GHz
+#define WIN_SHIFT 4 // rx_win is the server's window in bytes >> WIN_SHIFT, exact for -l >= 1 << WIN_SHIFT
+
+struct tcp_ts_opt {
+    uint8_t nop[2];
+    uint8_t kind;
+    uint8_t len;
+    rte_be32_t tsval;
+    rte_be32_t tsecr;
+} __rte_packed;
+
+/* LAB1 ECN feedback option the server puts after the timestamp, running mark counts */
+#define TCP_OPT_ECN 254
+#define TCP_OPT_ECN_LEN 10
+
+struct tcp_ecn_opt {
+    uint8_t nop[2];
+    uint8_t kind;
+    uint8_t len;
+    rte_be32_t ect; // segments the server got ECN capable, CE included
+    rte_be32_t ce;
+} __rte_packed;
+
+/* LAB1 file CRC option, after the timestamp on the FIN of a file transfer only */
+#define TCP_OPT_CRC 252 // unassigned, both ends are ours
+#define TCP_OPT_CRC_LEN 6
+
+struct tcp_crc_opt {
+    uint8_t nop[2];
+    uint8_t kind;
+    uint8_t len;
+    rte_be32_t crc; // CRC32C of the whole file
+} __rte_packed;
+
+/* LAB1 RPC option, last on a response: the byte offset just past the request it answers */
+#define TCP_OPT_RPC 253
+#define TCP_OPT_RPC_LEN 6
+
+struct tcp_rpc_opt {
+    uint8_t nop[2];
+    uint8_t kind;
+    uint8_t len;
+    rte_be32_t req_end;
+} __rte_packed;
+
+/* LAB1 flow scheduling policy */
+enum sched_policy {
+    POLICY_RR,   // round robin over flows, the original sending order
+    POLICY_SRF,  // shortest remaining first
+    POLICY_WFQ,  // weighted fair queuing on virtual finish time
+    POLICY_PRIO, // strict priority classes, round robin inside a class
+};
 
-/* LAB1 define slide window*/
-struct tx_window { // TODO add lock
-    int head; // seq of the first packet in the window [3,4,5,6|7,8] - 3
+#define PRIO_CLASSES 4
+#define WFQ_SCALE 65536
+
+/* class -> DSCP written into type_of_service, class 0 is the most urgent */
+static const uint8_t prio_dscp[PRIO_CLASSES] = {0x28, 0x20, 0x10, 0x00}; // CS5 CS4 CS2 CS0
+/* SRF demotes a flow one class each time its remaining packets pass a threshold */
+static const int srf_thresh[PRIO_CLASSES - 1] = {1, 10, 100};
+
+/*
+ * LAB1 define slide window
+ * Flow state is kept as structure of arrays on hugepages. Every packet
+ * touches one hot line per side: the TX lcore owns flow_tx, the RX lcore
+ * owns flow_rx, so the sent writer and the head/avail writer never share a
+ * line. Fields read by the other side are published with release stores
+ * and read with acquire loads, head/avail/cwnd are additionally covered by
+ * a seqcount for consistent multi-field snapshots. Everything else, stats,
+ * timers, RTT variance, DCTCP and RPC progress, lives in packed cold arrays
+ * written by a single side each, so the hot structs stay one line.
+ */
+struct flow_tx {
     int sent; // how many packet has been sent [3,4,5,6|7,8] - 6
-    // int size; // last time ack indicated win size [3,4,5,6|7,8] - 6
+    int sent_hwm; // sent plus the segments being handed to the NIC, acks are checked against it
+    uint32_t rtx_epoch; // last rx rtx_epoch served
+    int size; // total packets of this flow, the last one carries FIN
+    uint64_t vfinish; // WFQ virtual finish time of the last sent packet
+    int rpc_expired; // requests given up on, their responses were lost
+    uint8_t queued; // SCHED_Q_* structures the flow waits in
+    int rto_seq; // seq the expired timer wants retransmitted, -1 for none
+    uint32_t rto_fired; // timer expiries, RX collapses cwnd when this moves
+} __rte_cache_aligned;
+_Static_assert(sizeof(struct flow_tx) == RTE_CACHE_LINE_SIZE, "flow_tx must stay one cache line");
+
+struct flow_rx {
+    uint32_t snap; // seqcount, odd while head/avail/cwnd change
+    int head; // seq of the first packet in the window [3,4,5,6|7,8] - 3
     int avail; // max avail to sent packet
-    pthread_mutex_t lock;
+    int rtx_seq; // seq TX has to retransmit
+    uint32_t rtx_epoch; // moves with every rtx_seq store, TX serves each request once
+    uint32_t rto_seen; // tx rto_fired the window was last collapsed for
+    int rwnd; // last advertised receive window
+    int cwnd; // congestion window in packets
+    int cwnd_cnt; // acked packets towards the next congestion avoidance increment
+    int ssthresh;
+    int dupacks; // duplicate acks in a row
+    int recover; // highest seq sent when fast recovery started, NewReno
+    bool in_recovery;
+    uint64_t srtt; // smoothed rtt in TSC cycles, RFC 6298
+} __rte_cache_aligned;
+_Static_assert(sizeof(struct flow_rx) == RTE_CACHE_LINE_SIZE, "flow_rx must stay one cache line");
+
+/* TX side state read per pick or on timer expiry, not per packet */
+struct flow_tx_cold {
+    uint16_t port; // link the flow is pinned to, keeps its segments in order
+    uint16_t queue;
+    int weight; // WFQ share
+    int prio; // static priority class
+    int rto_head; // head when the timer was armed, it only fires if head stays
+    uint8_t rto_backoff; // doublings of the retransmission timer since head last moved
 };
 
-/* Define the mempool globally */
-struct rte_mempool *mbuf_pool = NULL;
-static struct rte_ether_addr my_eth;
+/* RX side state touched on rtt samples, marked acks and RPC responses */
+struct flow_rx_cold {
+    uint64_t rttvar;
+    int rpc_done; // requests answered in order, a response overtaking others skips them
+    /* DCTCP, on the server's mark counts */
+    uint32_t alpha; // estimated marked fraction, DCTCP_ONE is every segment
+    uint32_t ecn_ect; // counts when the current observation window began
+    uint32_t ecn_ce;
+    uint32_t ecn_last_ce; // ce of the previous ack, an increase is a fresh mark
+    int ecn_end; // alpha is updated once the ack passes this seq, about an rtt
+    int ecn_cut; // no second cut before the ack passes this seq
+    bool ecn_seen; // counts baseline taken
+};
 
-/* static timer */
-static uint64_t st[20];
-static uint64_t rt[20];
+struct flow_tx_stats {
+    uint64_t retransmits;
+    uint64_t win_stalls; // times the flow filled its window
+    uint64_t rpc_timeouts;
+    uint64_t rto_timeouts; // retransmission timer expiries
+};
 
-static size_t message_size = 1000;
-static uint32_t seconds = 1;
+struct flow_rx_stats {
+    uint64_t rto;
+    uint64_t rtt_min;
+    uint64_t rtt_cnt; // number of rtt samples
+    uint64_t rpc_lost; // requests skipped by a later response
+    uint64_t ecn_cuts; // window reductions on ECN marks
+    uint64_t bad_acks; // acks beyond what was sent, ignored
+};
 
-struct tx_window *window_list = NULL;
+/* hot path stages timed by PROBE_MARK when built with PROBES=1 */
+enum stage { ST_PICK, ST_BUILD, ST_GSO, ST_CKSUM, ST_TX, ST_RX, ST_PARSE, ST_WINDOW, ST_FREE, ST_NB };
+static const char *const stage_names[ST_NB] = {
+    "pick", "build", "gso", "cksum", "tx", "rx", "parse", "window", "free",
+};
+
+/* consistent view of the window for anyone but the RX lcore */
+struct win_snapshot {
+    int head;
+    int sent;
+    int avail;
+    int cwnd;
+};
 
-int flow_size = 10000;
-int packet_len = 1000;
+/* Define the mempool globally */
+static uint16_t used_ports[PORT_NUM]; // ports with a known peer, flows spread over them
+static uint16_t nb_used_ports = 0;
+static struct rte_ether_addr my_eth[RTE_MAX_ETHPORTS];
+/* server MAC behind each port, -m overrides */
+static struct rte_ether_addr dst_eth[RTE_MAX_ETHPORTS] = {
+    {{0x14,0x58,0xD0,0x58,0x2F,0x32}}, // eno1
+    {{0x14,0x58,0xD0,0x58,0x2F,0x33}}, // eno1d1
+};
+
+
+struct flow_tx *tx_win = NULL;
+struct flow_rx *rx_win = NULL;
+struct flow_tx_stats *tx_stats = NULL;
+struct flow_rx_stats *rx_stats = NULL;
+struct flow_tx_cold *tx_cold = NULL;
+struct flow_rx_cold *rx_cold = NULL;
+static int acked_flows = 0; // flows acked up to FIN, written by RX
+static unsigned rx_lcore = RTE_MAX_LCORE; // lcore polling acks, RTE_MAX_LCORE if TX polls them itself
+
+const char *flow_sizes = "10000"; // bytes per flow, comma separated, the last one repeats
+const char *flow_weights = NULL;
+const char *flow_classes = NULL;
+int packet_len = 1000; // payload per segment, the MSS
+static uint16_t mtu = RTE_ETHER_MTU;
+static uint32_t tso_bytes = 64 * 1024; // payload handed to the NIC at once
+static int max_segs = 1; // segments per super-frame, 1 when TSO/GSO is off
+static bool tso_hw[RTE_MAX_ETHPORTS]; // port segments itself, GSO in software otherwise
+static struct rte_gso_ctx gso_ctx;
 int flow_num = 1;
+static bool cksum_bench_only = false;
+static bool ecn_on = false; // -E, data leaves ECT(0) and marks cut cwnd the DCTCP way
+static struct rx_idle_conf idle_conf = RX_IDLE_CONF_DEFAULT;
+// burst, rings and mbuf cache, -B or picked by the -A sweep
+static struct tune_params io_params = TUNE_PARAMS_DEFAULT;
+static const char *tune_target;
+static bool rx_intr[RTE_MAX_ETHPORTS]; // port configured with rx queue interrupts
+static enum flowrule_level hw_filter[RTE_MAX_ETHPORTS]; // what the NIC already checked
+
+/*
+ * LAB1 RPC mode: a flow is a sequence of requests of rpc_segs segments,
+ * the last one of each carries PSH and the server answers once it has
+ * the whole request. Closed loop keeps rpc_outstanding requests in flight,
+ * open loop issues them every rpc_gap cycles whatever the answers do and
+ * measures from the scheduled time, so a slow server cannot hide queueing.
+ */
+static int rpc_req_bytes = 0; // 0 is bulk transfer
+static int rpc_segs = 1;
+static int rpc_outstanding = 1;
+static double rpc_rate = 0; // requests per second per flow, 0 is closed loop
+static uint64_t rpc_gap = 0;
+static uint64_t rpc_t0 = 0;
+static uint64_t *rpc_issue = NULL; // [flow * RPC_RING + req % RPC_RING] issue TSC, written by TX
+static struct hist rpc_lat; // request to response in TSC cycles, RX only
+static struct hist rtt_hist; // every rtt sample in TSC cycles, RX only
 
+/*
+ * LAB1 file streaming: every flow carries the file given with -f. The
+ * mapping is pinned and registered for DMA so payload goes out as external
+ * buffers attached behind the header mbuf, nothing is copied. Without
+ * IOVA as VA or when a port cannot map it, payload is copied instead.
+ */
+static const char *file_path = NULL;
+static uint8_t *file_data = NULL;
+static size_t file_size = 0;
+static size_t file_map_len = 0; // page rounded
+static bool file_zerocopy = false;
+static uint32_t file_crc = 0; // crc32c of the file, in a tcp_crc_opt on the FIN
+static struct rte_mbuf_ext_shared_info *file_shinfo = NULL; // one per flow, the refcnt is 16 bit
 
-static uint64_t raw_time(void) {
-    struct timespec tstart={0,0};
-    clock_gettime(CLOCK_MONOTONIC, &tstart);
-    uint64_t t = (uint64_t)(tstart.tv_sec*1.0e9 + tstart.tv_nsec);
-    return t;
+static enum sched_policy policy = POLICY_RR;
+static uint64_t vtime = 0; // WFQ virtual time
 
+/*
+ * LAB1 scheduler state, TX lcore only. A flow waits in the structures
+ * that can hand it out again: with new data to send in the ready list of
+ * its class (RR, PRIO) or the heap (SRF, WFQ), with a loss to repair in the
+ * retransmit list, held back by the open loop clock in the clock list.
+ * A flow found blocked when it comes up is dropped, whatever unblocks it
+ * queues it again: the RX side through wake_ring when an ack opens the
+ * window, asks for a retransmission or a response comes in, the clock
+ * when requests fall due, the timer wheel when a response is given up on.
+ */
+#define SCHED_Q_READY 1
+#define SCHED_Q_RTX 2
+#define SCHED_Q_CLOCK 4
+#define SCHED_SLOTS 1024 // timer wheel slots of SCHED_TICK_US, a turn is about 100ms
+#define SCHED_TICK_US 100
+#define SCHED_BURST 32 // wakes and timers handled per pick
+
+static struct flowq_fifo sched_ready; // a list per class, RR uses class 0
+static struct flowq_fifo sched_rtx;
+static struct flowq_fifo sched_clock;
+static struct flowq_heap sched_heap;
+static struct flowq_wheel sched_timers; // retransmission timer and RPC timeout of each flow
+#define RTO_TIMER(flow_id) (flow_id)
+#define RPC_TIMER(flow_id) (flow_num + (flow_id))
+static uint64_t rpc_next_release = 0; // open loop clock, next time requests fall due
+static struct rte_ring *wake_ring; // flows the RX side touched, each at most once
+static uint8_t *woken; // [flow_num] set by RX when it queues the flow, cleared by TX
+static uint32_t wake_buf[TUNE_MAX_BURST]; // RX side, wakes of the current burst
+static unsigned int nb_wake = 0;
+
+
+static inline uint32_t
+ts_now(void) {
+    return (uint32_t)(rte_rdtsc() >> TS_SHIFT);
 }
 
-static uint64_t time_now(uint64_t offset) {
-    return raw_time() - offset;
+/* timestamp option of the segment, NULL if it carries none */
+static inline struct tcp_ts_opt *
+get_ts_opt(struct rte_tcp_hdr *tcp_hdr)
+{
+    if ((tcp_hdr->data_off >> 4) * 4 < sizeof(*tcp_hdr) + sizeof(struct tcp_ts_opt))
+        return NULL;
+    struct tcp_ts_opt *opt = (struct tcp_ts_opt *)(tcp_hdr + 1);
+    if (opt->kind != TCP_OPT_TS || opt->len != TCP_OPT_TS_LEN)
+        return NULL;
+    return opt;
 }
 
-uint32_t
-checksum(unsigned char *buf, uint32_t nbytes, uint32_t sum)
+/* ECN count option of an ack, right behind the timestamp, NULL if it carries none */
+static inline struct tcp_ecn_opt *
+get_ecn_opt(struct rte_tcp_hdr *tcp_hdr)
 {
-	unsigned int	 i;
+    if ((tcp_hdr->data_off >> 4) * 4 < sizeof(*tcp_hdr) + sizeof(struct tcp_ts_opt) + sizeof(struct tcp_ecn_opt))
+        return NULL;
+    struct tcp_ecn_opt *opt = (struct tcp_ecn_opt *)((uint8_t *)(tcp_hdr + 1) + sizeof(struct tcp_ts_opt));
+    if (opt->kind != TCP_OPT_ECN || opt->len != TCP_OPT_ECN_LEN)
+        return NULL;
+    return opt;
+}
 
-	/* Checksum all the pairs of bytes first. */
-	for (i = 0; i < (nbytes & ~1U); i += 2) {
-		sum += (uint16_t)ntohs(*((uint16_t *)(buf + i)));
-		if (sum > 0xFFFF)
-			sum -= 0xFFFF;
-	}
+/* request option of a response, the last one in the header, NULL if it carries none */
+static inline struct tcp_rpc_opt *
+get_rpc_opt(struct rte_tcp_hdr *tcp_hdr)
+{
+    uint32_t hdr_len = (tcp_hdr->data_off >> 4) * 4;
+    if (hdr_len < sizeof(*tcp_hdr) + sizeof(struct tcp_rpc_opt))
+        return NULL;
+    struct tcp_rpc_opt *opt = (struct tcp_rpc_opt *)((uint8_t *)tcp_hdr + hdr_len - sizeof(struct tcp_rpc_opt));
+    if (opt->kind != TCP_OPT_RPC || opt->len != TCP_OPT_RPC_LEN)
+        return NULL;
+    return opt;
+}
 
-	if (i < nbytes) {
-		sum += buf[i] << 8;
-		if (sum > 0xFFFF)
-			sum -= 0xFFFF;
-	}
+/* compact per-burst view of the received acks */
+struct pkt_desc {
+    int flow_id; // -1 if the frame is not an ack of ours
+    int ack; // last segment the server has in order
+    int win; // its receive window in segments
+    uint32_t tsecr;
+    int rsp; // last seq of the request a response answers, -1 for a plain ack
+    bool ece;
+    bool ecn_opt; // ect and ce below came with the ack
+    uint32_t ect;
+    uint32_t ce;
+};
 
-	return sum;
-}
+/*
+ * First 32 bytes of a frame we accept: our MAC, IPv4 ethertype, IHL 5 so
+ * the TCP header sits at a fixed offset, and the lab protocol number.
+ * Built once after port_init so the hot path never asks the port for it.
+ */
+static uint8_t hdr_tpl[RTE_MAX_ETHPORTS][32] __rte_aligned(16); // one per port, the MAC differs
+static uint8_t hdr_mask[32] __rte_aligned(16);
 
-uint32_t
-wrapsum(uint32_t sum)
+static void
+init_parse_template(uint16_t port)
 {
-	sum = ~sum & 0xFFFF;
-	return htons(sum);
+    uint8_t *tpl = hdr_tpl[port];
+
+    memset(tpl, 0, sizeof(hdr_tpl[port]));
+    memset(hdr_mask, 0, sizeof(hdr_mask));
+    memcpy(tpl, &my_eth[port], RTE_ETHER_ADDR_LEN);
+    memset(hdr_mask, 0xff, RTE_ETHER_ADDR_LEN);
+    tpl[12] = RTE_ETHER_TYPE_IPV4 >> 8;
+    tpl[13] = RTE_ETHER_TYPE_IPV4 & 0xff;
+    hdr_mask[12] = hdr_mask[13] = 0xff;
+    tpl[14] = 0x45;
+    hdr_mask[14] = 0xff;
+    tpl[sizeof(struct rte_ether_hdr) + offsetof(struct rte_ipv4_hdr, next_proto_id)] = IP_PROTO;
+    hdr_mask[sizeof(struct rte_ether_hdr) + offsetof(struct rte_ipv4_hdr, next_proto_id)] = 0xff;
 }
 
-static int parse_packet(struct sockaddr_in *src,
-                        struct sockaddr_in *dst,
-                        int *ack,
-                        int *win,
-                        // void **payload,
-                        // size_t *payload_len,
-                        struct rte_mbuf *pkt)
+/* MAC, ethertype, IHL and protocol in one masked compare */
+static inline bool
+hdr_match(const uint8_t *p, const uint8_t *tpl)
 {
-    // packet layout order is (from outside -> in):
-    // ether_hdr
-    // ipv4_hdr
-    // udp_hdr
-    // client timestamp
-    uint8_t *p = rte_pktmbuf_mtod(pkt, uint8_t *);
-    size_t header = 0;
-
-    // check the ethernet header
-    struct rte_ether_hdr * const eth_hdr = (struct rte_ether_hdr *)(p);
-    p += sizeof(*eth_hdr);
-    header += sizeof(*eth_hdr);
-    uint16_t eth_type = ntohs(eth_hdr->ether_type);
-    struct rte_ether_addr mac_addr = {};
-
-    rte_eth_macaddr_get(1, &mac_addr);
-    if (!rte_is_same_ether_addr(&mac_addr, &eth_hdr->dst_addr)) {
-        printf("Bad MAC: %02" PRIx8 " %02" PRIx8 " %02" PRIx8
-			   " %02" PRIx8 " %02" PRIx8 " %02" PRIx8 "\n",
-            eth_hdr->dst_addr.addr_bytes[0], eth_hdr->dst_addr.addr_bytes[1],
-			eth_hdr->dst_addr.addr_bytes[2], eth_hdr->dst_addr.addr_bytes[3],
-			eth_hdr->dst_addr.addr_bytes[4], eth_hdr->dst_addr.addr_bytes[5]);
-        return 0;
-    }
-    if (RTE_ETHER_TYPE_IPV4 != eth_type) {
-        printf("Bad ether type\n");
-        return 0;
-    }
+#ifdef RTE_ARCH_X86
+    __m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i *)p),
+                               _mm_load_si128((const __m128i *)hdr_mask));
+    __m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i *)(p + 16)),
+                               _mm_load_si128((const __m128i *)(hdr_mask + 16)));
+    __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(lo, _mm_load_si128((const __m128i *)tpl)),
+                               _mm_cmpeq_epi8(hi, _mm_load_si128((const __m128i *)(tpl + 16))));
+    return _mm_movemask_epi8(eq) == 0xffff;
+#else
+    uint64_t w[4], diff = 0;
+    memcpy(w, p, sizeof(w));
+    for (int k = 0; k < 4; k++)
+        diff |= (w[k] & ((const uint64_t *)hdr_mask)[k]) ^ ((const uint64_t *)tpl)[k];
+    return diff == 0;
+#endif
+}
 
-    // check the IP header
-    struct rte_ipv4_hdr *const ip_hdr = (struct rte_ipv4_hdr *)(p);
-    p += sizeof(*ip_hdr);
-    header += sizeof(*ip_hdr);
+static __rte_always_inline void
+parse_one(struct rte_mbuf *pkt, bool ok, struct pkt_desc *d, const uint32_t plen)
+{
+    d->flow_id = -1;
+    if (!ok)
+        return;
 
-    // In network byte order.
-    in_addr_t ipv4_src_addr = ip_hdr->src_addr;
-    in_addr_t ipv4_dst_addr = ip_hdr->dst_addr;
+    struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, TCP_HDR_OFF);
+    // an ack swaps the ports of the data segment it answers
+    int lo = rte_be_to_cpu_16(tcp_hdr->src_port) - FLOW_PORT_BASE;
+    int hi = rte_be_to_cpu_16(tcp_hdr->dst_port) - FLOW_PORT_BASE;
+    if (lo < 0 || lo >= (1 << FLOW_PORT_BITS) || hi < 0 ||
+        ((hi << FLOW_PORT_BITS) | lo) >= flow_num)
+        return;
 
-    if (IPPROTO_IP != ip_hdr->next_proto_id) {
-        printf("Bad next proto_id\n");
-        return 0;
+    d->flow_id = (hi << FLOW_PORT_BITS) | lo;
+    // the wire counts bytes in network order, the windows here count segments
+    d->ack = (int)(rte_be_to_cpu_32(tcp_hdr->recv_ack) / plen) - 1;
+    d->win = ((uint32_t)rte_be_to_cpu_16(tcp_hdr->rx_win) << WIN_SHIFT) / plen;
+    struct tcp_rpc_opt *rpc = (tcp_hdr->tcp_flags & RTE_TCP_PSH_FLAG) ? get_rpc_opt(tcp_hdr) : NULL;
+    d->rsp = rpc ? (int)(rte_be_to_cpu_32(rpc->req_end) / plen) - 1 : -1;
+    struct tcp_ts_opt *ts = get_ts_opt(tcp_hdr);
+    d->tsecr = ts ? rte_be_to_cpu_32(ts->tsecr) : 0;
+    d->ece = (tcp_hdr->tcp_flags & RTE_TCP_ECE_FLAG) != 0;
+    struct tcp_ecn_opt *ecn = ecn_on ? get_ecn_opt(tcp_hdr) : NULL;
+    d->ecn_opt = ecn != NULL;
+    if (ecn != NULL) {
+        d->ect = rte_be_to_cpu_32(ecn->ect);
+        d->ce = rte_be_to_cpu_32(ecn->ce);
     }
-    
-    src->sin_addr.s_addr = ipv4_src_addr;
-    dst->sin_addr.s_addr = ipv4_dst_addr;
-    
-    // check udp header
-    // struct rte_udp_hdr * const udp_hdr = (struct rte_udp_hdr *)(p);
-    struct rte_tcp_hdr * const tcp_hdr = (struct rte_tcp_hdr *)(p);
-    p += sizeof(*tcp_hdr);
-    header += sizeof(*tcp_hdr);
-
-    // In network byte order.
-    in_port_t tcp_src_port = tcp_hdr->src_port;
-    in_port_t tcp_dst_port = tcp_hdr->dst_port;
-    int ret = 0;
-	
-    for (int i = 1; i < MAX_FLOWS + 1; i++)
-        if (tcp_hdr->dst_port == rte_cpu_to_be_16(5000 + i)) {
-            ret = i;
-            break;
-        }
-
-    src->sin_port = tcp_src_port;
-    dst->sin_port = tcp_dst_port;
-    
-    src->sin_family = AF_INET;
-    dst->sin_family = AF_INET;
-    
-    // *payload_len = pkt->pkt_len - header;
-    // *payload = (void *)p;
-
-    *ack = (int) tcp_hdr->recv_ack;
-    *win = (int) tcp_hdr->rx_win;
-    return ret;
+}
 
+/*
+ * Parse a whole RX burst into desc[], four frames per round with the
+ * headers of the frames PREFETCH_OFFSET ahead already on their way.
+ */
+static __rte_always_inline void
+parse_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb, struct pkt_desc *desc, const uint32_t plen)
+{
+    const uint32_t min_len = TCP_HDR_OFF + sizeof(struct rte_tcp_hdr);
+    const uint8_t *tpl = hdr_tpl[port];
+    const bool hw = hw_filter[port] == FLOWRULE_EXACT; // the NIC dropped everything else
+    uint16_t i;
+
+    for (i = 0; i < nb && i < PREFETCH_OFFSET; i++)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+
+    for (i = 0; i + 4 <= nb; i += 4) {
+        for (int k = 0; k < 4; k++)
+            if (i + k + PREFETCH_OFFSET < nb)
+                rte_prefetch0(rte_pktmbuf_mtod(pkts[i + k + PREFETCH_OFFSET], void *));
+        bool ok0 = pkts[i]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i], uint8_t *), tpl));
+        bool ok1 = pkts[i + 1]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 1], uint8_t *), tpl));
+        bool ok2 = pkts[i + 2]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 2], uint8_t *), tpl));
+        bool ok3 = pkts[i + 3]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 3], uint8_t *), tpl));
+        parse_one(pkts[i], ok0, &desc[i], plen);
+        parse_one(pkts[i + 1], ok1, &desc[i + 1], plen);
+        parse_one(pkts[i + 2], ok2, &desc[i + 2], plen);
+        parse_one(pkts[i + 3], ok3, &desc[i + 3], plen);
+    }
+    for (; i < nb; i++)
+        parse_one(pkts[i], pkts[i]->data_len >= min_len && (hw ||
+                  hdr_match(rte_pktmbuf_mtod(pkts[i], uint8_t *), tpl)), &desc[i], plen);
 }
+
 /* basicfwd.c: Basic DPDK skeleton forwarding example. */
 
 /*
@@ -216,14 +534,16 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 {
 	struct rte_eth_conf port_conf;
 	const uint16_t rx_rings = 1, tx_rings = 1;
-	uint16_t nb_rxd = RX_RING_SIZE;
-	uint16_t nb_txd = TX_RING_SIZE;
+	uint16_t nb_rxd = io_params.rx_ring;
+	uint16_t nb_txd = io_params.tx_ring;
 	int retval;
 	uint16_t q;
 	struct rte_eth_dev_info dev_info;
 	struct rte_eth_txconf txconf;
 
     printf("port avail id: %u\n", port);
+	if (pktio_backend != PKTIO_DPDK)
+		return pktio_port_init(port, mbuf_pool, mtu, &my_eth[port]);
 
 	if (!rte_eth_dev_is_valid_port(port))
 		return -1;
@@ -238,14 +558,41 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 		return retval;
 	}
 
-	if (dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE)
+	const uint64_t tso_offloads = RTE_ETH_TX_OFFLOAD_TCP_TSO | RTE_ETH_TX_OFFLOAD_IPV4_CKSUM |
+		RTE_ETH_TX_OFFLOAD_TCP_CKSUM;
+	if (max_segs > 1 && (dev_info.tx_offload_capa & tso_offloads) == tso_offloads) {
+		port_conf.txmode.offloads |= tso_offloads;
+		tso_hw[port] = true;
+	}
+	printf("port %u: %s segmentation\n", port,
+		   max_segs == 1 ? "no" : tso_hw[port] ? "TSO" : "software (GSO)");
+	if (dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MULTI_SEGS)
+		port_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_MULTI_SEGS;
+	// GSO segments are indirect mbufs and file payload external, fast free only takes direct ones
+	if ((dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE) &&
+		(max_segs == 1 || tso_hw[port]) && !file_zerocopy)
 		port_conf.txmode.offloads |=
 			RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE;
 
 	/* Configure the Ethernet device. */
+	rx_idle_port_conf(&idle_conf, &port_conf);
 	retval = rte_eth_dev_configure(port, rx_rings, tx_rings, &port_conf);
+	if (retval != 0 && port_conf.intr_conf.rxq) {
+		// not every PMD does rx interrupts, idle by pausing instead
+		port_conf.intr_conf.rxq = 0;
+		retval = rte_eth_dev_configure(port, rx_rings, tx_rings, &port_conf);
+	}
 	if (retval != 0)
 		return retval;
+	rx_intr[port] = port_conf.intr_conf.rxq;
+
+	if (mtu != RTE_ETHER_MTU) {
+		retval = rte_eth_dev_set_mtu(port, mtu);
+		if (retval != 0) {
+			printf("port %u: cannot set mtu %u (max %u)\n", port, mtu, dev_info.max_mtu);
+			return retval;
+		}
+	}
 
 	retval = rte_eth_dev_adjust_nb_rx_tx_desc(port, &nb_rxd, &nb_txd);
 	if (retval != 0)
@@ -278,13 +625,22 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 		return retval;
 
 	/* Display the port MAC address. */
-	retval = rte_eth_macaddr_get(port, &my_eth);
+	retval = rte_eth_macaddr_get(port, &my_eth[port]);
 	if (retval != 0)
 		return retval;
 
 	printf("Port %u MAC: %02" PRIx8 " %02" PRIx8 " %02" PRIx8
 		   " %02" PRIx8 " %02" PRIx8 " %02" PRIx8 "\n",
-		   port, RTE_ETHER_ADDR_BYTES(&my_eth));
+		   port, RTE_ETHER_ADDR_BYTES(&my_eth[port]));
+
+	/* acks swap the ports: src carries the low bits of the flow id, dst the high ones */
+	const struct flowrule_range range = {
+		FLOW_PORT_BASE, FLOW_PORT_BASE + RTE_MIN(flow_num, 1 << FLOW_PORT_BITS) - 1,
+		FLOW_PORT_BASE, FLOW_PORT_BASE + ((flow_num - 1) >> FLOW_PORT_BITS), 0,
+	};
+	hw_filter[port] = flowrule_install(port, &my_eth[port], IP_PROTO, &range, 1);
+	if (hw_filter[port] != FLOWRULE_NONE)
+		return 0;
 
 	/* Enable RX in promiscuous mode for the Ethernet device. */
 	retval = rte_eth_promiscuous_enable(port);
@@ -298,284 +654,1449 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 
 /* >8 End Basic forwarding application lcore. */
 
+/* map -f and take its crc, the mapping is populated and locked so it can be DMA mapped */
+static int
+file_open(void)
+{
+    struct stat st;
+    int fd = open(file_path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("cannot open %s: %s\n", file_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    // seq on the wire is a 32 bit byte offset
+    if (st.st_size == 0 || (uint64_t)st.st_size > UINT32_MAX) {
+        printf("%s should hold 1 byte to 4GB\n", file_path);
+        close(fd);
+        return -1;
+    }
+    file_size = st.st_size;
+    file_map_len = RTE_ALIGN_CEIL(file_size, (size_t)sysconf(_SC_PAGESIZE));
+    file_data = mmap(NULL, file_map_len, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (file_data == MAP_FAILED) {
+        file_data = NULL;
+        printf("cannot map %s: %s\n", file_path, strerror(errno));
+        return -1;
+    }
+    madvise(file_data, file_map_len, MADV_SEQUENTIAL);
+    file_crc = rte_hash_crc(file_data, file_size, 0);
+    printf("%s: %zu bytes, crc32c %08x\n", file_path, file_size, file_crc);
+    return 0;
+}
+
+/* external buffers need the mapping visible to every port's DMA, copy otherwise */
+static void
+file_dma_map(void)
+{
+    size_t pgsz = sysconf(_SC_PAGESIZE);
+    uint16_t p;
+
+    if (rte_eal_iova_mode() != RTE_IOVA_VA || mlock(file_data, file_map_len) != 0 ||
+        rte_extmem_register(file_data, file_map_len, NULL, 0, pgsz) != 0) {
+        printf("file payload is copied, no zero copy without IOVA as VA and a locked mapping\n");
+        return;
+    }
+    for (p = 0; p < nb_used_ports; p++) {
+        struct rte_eth_dev_info info;
+        if (rte_eth_dev_info_get(used_ports[p], &info) != 0 ||
+            rte_dev_dma_map(info.device, file_data, (uint64_t)(uintptr_t)file_data, file_map_len) != 0)
+            break;
+    }
+    if (p < nb_used_ports) {
+        printf("port %u cannot DMA map the file, payload is copied\n", used_ports[p]);
+        while (p-- > 0) {
+            struct rte_eth_dev_info info;
+            if (rte_eth_dev_info_get(used_ports[p], &info) == 0)
+                rte_dev_dma_unmap(info.device, file_data, (uint64_t)(uintptr_t)file_data, file_map_len);
+        }
+        rte_extmem_unregister(file_data, file_map_len);
+        munlock(file_data, file_map_len);
+        return;
+    }
+    file_zerocopy = true;
+    printf("file payload attached zero copy\n");
+}
+
+static void
+file_close(void)
+{
+    if (file_data != NULL)
+        munmap(file_data, file_map_len);
+}
+
+/* the mapping outlives every mbuf, nothing to release */
+static void
+file_buf_free(__rte_unused void *addr, __rte_unused void *opaque)
+{
+}
+
+/* value #idx of a comma separated list, the last value repeats */
+static int
+list_value(const char *list, int idx, int dflt)
+{
+    if (list == NULL)
+        return dflt;
+    int v = dflt;
+    const char *p = list;
+    for (int i = 0; i <= idx; i++) {
+        char *end;
+        v = (int) strtol(p, &end, 10);
+        if (*end != ',')
+            break;
+        p = end + 1;
+    }
+    return v;
+}
+
 static int
 init_window(size_t flow_num){
-    window_list = (struct tx_window*) malloc(sizeof(struct tx_window) * (flow_num));
-    if (window_list == NULL) {
+    int socket = rte_socket_id();
+
+    /* hot arrays are line aligned per entry, rte_zmalloc hands out hugepage memory */
+    tx_win = rte_zmalloc_socket("flow_tx", sizeof(*tx_win) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    rx_win = rte_zmalloc_socket("flow_rx", sizeof(*rx_win) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    tx_stats = rte_zmalloc_socket("flow_tx_stats", sizeof(*tx_stats) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    rx_stats = rte_zmalloc_socket("flow_rx_stats", sizeof(*rx_stats) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    tx_cold = rte_zmalloc_socket("flow_tx_cold", sizeof(*tx_cold) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    rx_cold = rte_zmalloc_socket("flow_rx_cold", sizeof(*rx_cold) * flow_num, RTE_CACHE_LINE_SIZE, socket);
+    if (file_data != NULL)
+        file_shinfo = rte_zmalloc_socket("file_shinfo", sizeof(*file_shinfo) * flow_num,
+                                         RTE_CACHE_LINE_SIZE, socket);
+    if (rpc_req_bytes)
+        rpc_issue = rte_zmalloc_socket("rpc_issue", sizeof(*rpc_issue) * flow_num * RPC_RING,
+                                       RTE_CACHE_LINE_SIZE, socket);
+    if (tx_win == NULL || rx_win == NULL || tx_stats == NULL || rx_stats == NULL ||
+        tx_cold == NULL || rx_cold == NULL ||
+        (rpc_req_bytes && rpc_issue == NULL) || (file_data != NULL && file_shinfo == NULL)) {
         printf("fail to create tx window list.\n");
         return 1;
     }
-    for (int i = 0; i<flow_num ; i++){ 
-        window_list[i].head = 0;
-        window_list[i].sent = -1;
-        // window_list[i].size = MAX_WIN_SIZE; // since no hand shake, we dont know the inital rwnd, just max it
-        window_list[i].avail = MAX_WIN_SIZE - 1;
-        INIT(window_list[i].lock);
+    /* scheduler queues, sized for every flow waiting at once */
+    void *ready = rte_zmalloc_socket("sched_ready", flowq_fifo_memsize(flow_num, PRIO_CLASSES),
+                                     RTE_CACHE_LINE_SIZE, socket);
+    void *rtx = rte_zmalloc_socket("sched_rtx", flowq_fifo_memsize(flow_num, 1), RTE_CACHE_LINE_SIZE, socket);
+    void *clock = rte_zmalloc_socket("sched_clock", flowq_fifo_memsize(flow_num, 1), RTE_CACHE_LINE_SIZE, socket);
+    void *heap = rte_zmalloc_socket("sched_heap", flowq_heap_memsize(flow_num), RTE_CACHE_LINE_SIZE, socket);
+    void *timers = rte_zmalloc_socket("sched_timers", flowq_wheel_memsize(2 * flow_num, SCHED_SLOTS),
+                                      RTE_CACHE_LINE_SIZE, socket);
+    woken = rte_zmalloc_socket("woken", flow_num, RTE_CACHE_LINE_SIZE, socket);
+    wake_ring = rte_ring_create_elem("wake_ring", sizeof(uint32_t), flow_num, socket,
+                                     RING_F_SP_ENQ | RING_F_SC_DEQ | RING_F_EXACT_SZ);
+    if (ready == NULL || rtx == NULL || clock == NULL || heap == NULL || timers == NULL ||
+        woken == NULL || wake_ring == NULL) {
+        printf("fail to create the scheduler queues.\n");
+        return 1;
+    }
+    flowq_fifo_init(&sched_ready, ready, flow_num, PRIO_CLASSES);
+    flowq_fifo_init(&sched_rtx, rtx, flow_num, 1);
+    flowq_fifo_init(&sched_clock, clock, flow_num, 1);
+    flowq_heap_init(&sched_heap, heap, flow_num);
+    flowq_wheel_init(&sched_timers, timers, 2 * flow_num, SCHED_SLOTS,
+                     rte_get_tsc_hz() / 1000000 * SCHED_TICK_US, rte_rdtsc());
+    for (int i = 0; i < (int)flow_num; i++){
+        int size = list_value(flow_sizes, i, 10000);
+        tx_win[i].sent = -1;
+        tx_win[i].sent_hwm = -1;
+        tx_win[i].rto_seq = -1;
+        tx_win[i].size = 1 + (size - 1) / packet_len; // ceiling round instead of floor round
+        if (rpc_req_bytes) // whole requests, size rounds up to the next one
+            tx_win[i].size = (1 + (size - 1) / rpc_req_bytes) * rpc_segs;
+        if (file_data != NULL) {
+            tx_win[i].size = 1 + (file_size - 1) / packet_len;
+            file_shinfo[i].free_cb = file_buf_free;
+            file_shinfo[i].fcb_opaque = NULL;
+            rte_mbuf_ext_refcnt_set(&file_shinfo[i], 1); // the mapping itself, never dropped
+        }
+        tx_cold[i].weight = list_value(flow_weights, i, 1);
+        tx_cold[i].prio = list_value(flow_classes, i, PRIO_CLASSES - 1);
+        if (size < 1 || tx_cold[i].weight < 1 ||
+            tx_cold[i].prio < 0 || tx_cold[i].prio >= PRIO_CLASSES) {
+            printf("bad size/weight/class for flow #%d\n", i);
+            return 1;
+        }
+        // spread flows over the links, a flow never changes port so it stays in order
+        tx_cold[i].port = used_ports[i % nb_used_ports];
+        tx_cold[i].queue = 0;
+
+        rx_win[i].head = 0;
+        // no handshake, the first acks tell the real rwnd
+        rx_win[i].avail = RTE_MIN(INIT_RWND, INIT_CWND) - 1;
+        rx_win[i].rtx_seq = -1;
+        rx_win[i].rwnd = INIT_RWND;
+        rx_win[i].cwnd = INIT_CWND;
+        rx_win[i].ssthresh = MAX_CWND;
+        rx_win[i].recover = -1;
+        rx_cold[i].alpha = DCTCP_ONE; // RFC 8257 starts from every segment marked
+
+        rx_stats[i].rto = rte_get_tsc_hz(); // 1s before the first sample
+        rx_stats[i].rtt_min = UINT64_MAX;
     }
     return 0;
 }
 
+static void
+release_window(){
+    rte_free(tx_win);
+    rte_free(rx_win);
+    rte_free(tx_stats);
+    rte_free(rx_stats);
+    rte_free(tx_cold);
+    rte_free(rx_cold);
+    rte_free(rpc_issue);
+    rte_free(file_shinfo);
+    rte_free(sched_ready.next);
+    rte_free(sched_rtx.next);
+    rte_free(sched_clock.next);
+    rte_free(sched_heap.ent);
+    rte_free(sched_timers.expire);
+    rte_free(woken);
+    rte_ring_free(wake_ring);
+}
+
 static bool
 check_window(size_t flow_id){
-    return window_list[flow_id].avail > window_list[flow_id].sent;
+    return LOAD_ACQ(rx_win[flow_id].avail) > tx_win[flow_id].sent;
 }
 
 static void
-slide_window_onair(size_t flow_id){
-    LOCK(window_list[flow_id].lock);
-    window_list[flow_id].sent += 1;
-    UNLOCK(window_list[flow_id].lock);
+slide_window_onair(size_t flow_id, int nseg){
+    STORE_REL(tx_win[flow_id].sent, tx_win[flow_id].sent + nseg);
+}
+
+/* RX side of the seqcount around head/avail/cwnd updates */
+static inline void
+snap_write_begin(struct flow_rx *w){
+    __atomic_store_n(&w->snap, w->snap + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+snap_write_end(struct flow_rx *w){
+    __atomic_store_n(&w->snap, w->snap + 1, __ATOMIC_RELEASE);
 }
 
 static void
-slide_window_ack(size_t flow_id, uint16_t ack, uint16_t new_size){
-    printf("Receive acks of #%d in flow #%d\n", ack, flow_id);
-    if (ack < window_list[flow_id].head) {
-        printf("already acked %u\n", ack);
-        return;
+window_snapshot(size_t flow_id, struct win_snapshot *ws){
+    struct flow_rx *w = &rx_win[flow_id];
+    uint32_t begin;
+
+    for (;;) {
+        begin = __atomic_load_n(&w->snap, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            rte_pause();
+            continue;
+        }
+        ws->head = __atomic_load_n(&w->head, __ATOMIC_RELAXED);
+        ws->avail = __atomic_load_n(&w->avail, __ATOMIC_RELAXED);
+        ws->cwnd = __atomic_load_n(&w->cwnd, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&w->snap, __ATOMIC_RELAXED) == begin)
+            break;
+    }
+    ws->sent = LOAD_ACQ(tx_win[flow_id].sent);
+}
+
+/* packets of the flow not yet put on the wire */
+static inline int
+remaining(size_t flow_id){
+    return tx_win[flow_id].size - 1 - tx_win[flow_id].sent;
+}
+
+/*
+ * seq of a pending retransmission, -1 for none. It goes out even when the
+ * window is full. RX asks for one by moving rtx_epoch, so it can ask for
+ * the same seq again once that retransmission got lost, the retransmission
+ * timer asks through rto_seq. *epoch is recorded once the segment is out.
+ */
+static inline int
+rtx_next(size_t flow_id, uint32_t *epoch){
+    struct flow_tx *t = &tx_win[flow_id];
+    uint32_t e = LOAD_ACQ(rx_win[flow_id].rtx_epoch);
+    int head = LOAD_ACQ(rx_win[flow_id].head);
+
+    *epoch = t->rtx_epoch;
+    if (e != t->rtx_epoch) {
+        int seq = LOAD_ACQ(rx_win[flow_id].rtx_seq);
+        if (seq >= head) {
+            *epoch = e;
+            return seq;
+        }
+        t->rtx_epoch = e; // acked in the meantime
+    }
+    return t->rto_seq >= head ? t->rto_seq : -1;
+}
+
+static inline bool
+rtx_pending(size_t flow_id){
+    uint32_t epoch;
+    return rtx_next(flow_id, &epoch) >= 0;
+}
+
+/* requests done from the sender's view, answered or given up on */
+static inline int
+rpc_finished(size_t flow_id){
+    return RTE_MAX(LOAD_ACQ(rx_cold[flow_id].rpc_done), tx_win[flow_id].rpc_expired);
+}
+
+/* segments of flow_id released for sending by the RPC load, the whole flow outside RPC mode */
+static inline int
+rpc_limit(size_t flow_id){
+    if (!rpc_req_bytes)
+        return tx_win[flow_id].size;
+    int done = rpc_finished(flow_id);
+    int released = done + rpc_outstanding;
+    if (rpc_gap)
+        released = RTE_MIN((int)((rte_rdtsc() - rpc_t0) / rpc_gap) + 1, done + RPC_RING);
+    return released * rpc_segs;
+}
+
+static inline bool
+sendable(size_t flow_id){
+    return rtx_pending(flow_id) || (remaining(flow_id) > 0 && check_window(flow_id) &&
+                                    tx_win[flow_id].sent + 1 < rpc_limit(flow_id));
+}
+
+static bool
+all_acked(){
+    return LOAD_ACQ(acked_flows) >= flow_num;
+}
+
+static int
+flow_prio(size_t flow_id){
+    if (policy != POLICY_SRF)
+        return tx_cold[flow_id].prio;
+    int left = remaining(flow_id);
+    for (int c = 0; c < PRIO_CLASSES - 1; c++)
+        if (left <= srf_thresh[c])
+            return c;
+    return PRIO_CLASSES - 1;
+}
+
+/* DSCP of the flow class, ECT(0) with -E except on retransmissions (RFC 3168 6.1.5) */
+static inline uint8_t
+flow_tos(size_t flow_id, bool rtx){
+    return prio_dscp[flow_prio(flow_id)] << 2 | (ecn_on && !rtx ? RTE_IPV4_HDR_ECN_ECT0 : 0);
+}
+
+/* virtual finish time the next packet of flow_id would get */
+static inline uint64_t
+wfq_next(size_t flow_id){
+    return RTE_MAX(tx_win[flow_id].vfinish, vtime) + WFQ_SCALE / tx_cold[flow_id].weight;
+}
+
+/*
+ * TX side: put flow_id where the scheduler finds it for whatever it can
+ * send now, or on the clock list if only the open loop holds it back.
+ * Nothing if it is blocked otherwise or already waiting in the right place.
+ */
+static void
+sched_queue(size_t flow_id){
+    struct flow_tx *t = &tx_win[flow_id];
+
+    if (!(t->queued & SCHED_Q_RTX) && rtx_pending(flow_id)) {
+        flowq_fifo_push(&sched_rtx, 0, flow_id);
+        t->queued |= SCHED_Q_RTX;
     }
-    if (ack > window_list[flow_id].sent) {
-        printf("get ack about not sent packet(%d/%d) for flow#%d.\n",
-            ack, window_list[flow_id].sent, flow_id);
+    if (t->queued & (SCHED_Q_READY | SCHED_Q_CLOCK))
         return;
+    if (remaining(flow_id) <= 0 || !check_window(flow_id))
+        return; // done or window full, an ack brings it back
+    if (t->sent + 1 < rpc_limit(flow_id)) {
+        switch (policy) {
+        case POLICY_SRF:
+            flowq_heap_push(&sched_heap, flow_id, remaining(flow_id));
+            break;
+        case POLICY_WFQ:
+            flowq_heap_push(&sched_heap, flow_id, wfq_next(flow_id));
+            break;
+        case POLICY_PRIO:
+            flowq_fifo_push(&sched_ready, tx_cold[flow_id].prio, flow_id);
+            break;
+        default:
+            flowq_fifo_push(&sched_ready, 0, flow_id);
+            break;
+        }
+        t->queued |= SCHED_Q_READY;
+    } else if (rpc_gap) {
+        flowq_fifo_push(&sched_clock, 0, flow_id);
+        t->queued |= SCHED_Q_CLOCK;
     }
+}
 
-    LOCK(window_list[flow_id].lock);
-    window_list[flow_id].head = ack + 1;
-    window_list[flow_id].avail = ack + new_size;
-    if (window_list[flow_id].sent > window_list[flow_id].avail) 
-        printf("the window shrinks too much\n");
+/*
+ * RX side: flow_id's window, retransmission or RPC state changed. Queued
+ * for TX at most once, the exchanges order the RX stores before TX reads
+ * the state again after clearing the flag.
+ */
+static inline void
+wake_flow(size_t flow_id){
+    if (__atomic_exchange_n(&woken[flow_id], 1, __ATOMIC_SEQ_CST) == 0)
+        wake_buf[nb_wake++] = flow_id;
+}
 
-    UNLOCK(window_list[flow_id].lock);
+/* RX side, hands the wakes of a burst to TX, the ring has room for every flow */
+static inline void
+wake_flush(){
+    if (nb_wake == 0)
+        return;
+    rte_ring_sp_enqueue_burst_elem(wake_ring, wake_buf, sizeof(uint32_t), nb_wake, NULL);
+    nb_wake = 0;
 }
 
-static uint64_t receive_once();
+static void rpc_timeout(size_t flow_id, uint64_t now);
+static void rto_timeout(size_t flow_id, uint64_t now);
+
+/* TX side: flows woken by acks, due open loop requests and expired timers */
+static void
+sched_poll(){
+    uint32_t ids[SCHED_BURST];
+    uint64_t now = rte_rdtsc();
+    unsigned int n, i;
+
+    n = rte_ring_sc_dequeue_burst_elem(wake_ring, ids, sizeof(uint32_t), SCHED_BURST, NULL);
+    for (i = 0; i < n; i++) {
+        __atomic_exchange_n(&woken[ids[i]], 0, __ATOMIC_SEQ_CST);
+        sched_queue(ids[i]);
+    }
+    if (rpc_gap && now >= rpc_next_release) {
+        /* requests fall due on every flow at once, the still blocked go back */
+        uint32_t f = flowq_fifo_take(&sched_clock, 0);
+        rpc_next_release = rpc_t0 + ((now - rpc_t0) / rpc_gap + 1) * rpc_gap;
+        while (f != FLOWQ_NONE) {
+            uint32_t next = flowq_fifo_next(&sched_clock, f);
+            tx_win[f].queued &= ~SCHED_Q_CLOCK;
+            sched_queue(f);
+            f = next;
+        }
+    }
+    n = flowq_wheel_expire(&sched_timers, now, ids, SCHED_BURST);
+    for (i = 0; i < n; i++) {
+        if (ids[i] < (uint32_t)flow_num)
+            rto_timeout(ids[i], now);
+        else
+            rpc_timeout(ids[i] - flow_num, now);
+    }
+}
+
+/* every flow starts out sendable, in flow order */
+static void
+sched_start(){
+    rpc_next_release = rpc_t0 + rpc_gap;
+    for (int i = 0; i < flow_num; i++)
+        sched_queue(i);
+}
+
+/*
+ * Pick the next flow to send from, -1 if every flow is finished or blocked
+ * by its window. Losses are repaired first, then the policy decides, equal
+ * SRF/WFQ keys and flows of one class take turns. The caller queues the
+ * flow again after sending.
+ */
 static int
-lcore_main()
-{
-    struct rte_mbuf *pkt;
-    // char *buf_ptr;
-    struct rte_ether_hdr *eth_hdr;
-    struct rte_ipv4_hdr *ipv4_hdr;
-    // struct rte_udp_hdr *udp_hdr;
-    struct rte_tcp_hdr *tcp_hdr;
+pick_flow(){
+    uint32_t f;
+
+    sched_poll();
+    while ((f = flowq_fifo_pop(&sched_rtx, 0)) != FLOWQ_NONE) {
+        tx_win[f].queued &= ~SCHED_Q_RTX;
+        if (rtx_pending(f))
+            return f;
+    }
+    for (;;) {
+        if (policy == POLICY_SRF || policy == POLICY_WFQ)
+            f = flowq_heap_pop(&sched_heap);
+        else
+            f = flowq_fifo_pop_first(&sched_ready);
+        if (f == FLOWQ_NONE)
+            return -1;
+        tx_win[f].queued &= ~SCHED_Q_READY;
+        if (sendable(f))
+            return f;
+    }
+}
 
-    // Specify the dst mac address here: 
-    // struct rte_ether_addr dst = {{0x14,0x58,0xD0,0x58,0x2F,0x32}}; // eno1
-    struct rte_ether_addr dst = {{0x14,0x58,0xD0,0x58,0x2F,0x33}}; // eno1d1
+/* start-time fair queuing bookkeeping for nseg segments leaving flow_id */
+static void
+wfq_account(size_t flow_id, int nseg){
+    vtime = RTE_MAX(tx_win[flow_id].vfinish, vtime);
+    tx_win[flow_id].vfinish = vtime + (uint64_t)nseg * WFQ_SCALE / tx_cold[flow_id].weight;
+}
 
-	struct sliding_hdr *sld_h_ack;
-    // uint64_t reqs = 0;
-    // uint64_t cycle_wait = intersend_time * rte_get_timer_hz() / (1e9);
-    
-    // TODO: add in scaffolding for timing/printing out quick statistics
-    // int outstanding[flow_num];
-    // uint16_t seq[flow_num];
-    size_t flow_id = 0;
-    // for(size_t i = 0; i < flow_num; i++)
-    // {
-    //     // outstanding[i] = 0;
-    //     seq[i] = 0;
-    // }  // flow[i] : 500i -> 500i
-
-    while (window_list[flow_id].sent < NUM_PING-1) {
-        if (!check_window(flow_id)) { // skip this flow sending when its slidewindow is full
-            flow_id = (flow_id+1) % flow_num;
-            receive_once();
+/* feed one echoed timestamp into the flow's RFC 6298 estimator */
+static void
+rtt_sample(size_t flow_id, uint32_t tsecr){
+    struct flow_rx *w = &rx_win[flow_id];
+    struct flow_rx_cold *c = &rx_cold[flow_id];
+    struct flow_rx_stats *st = &rx_stats[flow_id];
+    uint64_t rtt = (uint64_t)(uint32_t)(ts_now() - tsecr) << TS_SHIFT;
+
+    if (st->rtt_cnt == 0) {
+        w->srtt = rtt;
+        c->rttvar = rtt / 2;
+    } else {
+        uint64_t err = rtt > w->srtt ? rtt - w->srtt : w->srtt - rtt;
+        c->rttvar = (3 * c->rttvar + err) / 4;
+        w->srtt = (7 * w->srtt + rtt) / 8;
+    }
+    // read by TX when it arms the timer
+    STORE_REL(st->rto, w->srtt + RTE_MAX(4 * c->rttvar, rte_get_tsc_hz() / 1000)); // 1ms clock granularity
+    st->rtt_min = RTE_MIN(st->rtt_min, rtt);
+    st->rtt_cnt++;
+    hist_add(&rtt_hist, rtt);
+}
+
+static void
+rtt_summary(){
+    double us = 1e6 / rte_get_tsc_hz();
+    for (int i = 0; i < flow_num; i++) {
+        struct flow_rx *w = &rx_win[i];
+        struct flow_rx_cold *c = &rx_cold[i];
+        struct flow_rx_stats *st = &rx_stats[i];
+        if (st->rtt_cnt == 0) {
+            printf("flow #%d: no rtt sample\n", i);
             continue;
         }
-        // send a packet
-        pkt = rte_pktmbuf_alloc(mbuf_pool);
-        if (pkt == NULL) {
-            printf("Error allocating tx mbuf\n");
-            return -EINVAL;
+        printf("flow #%d: %" PRIu64 " samples, min %.2fus srtt %.2fus rttvar %.2fus rto %.2fus, %" PRIu64 " retransmits, %" PRIu64 " timeouts\n",
+            i, st->rtt_cnt, st->rtt_min * us, w->srtt * us, c->rttvar * us, st->rto * us,
+            tx_stats[i].retransmits, tx_stats[i].rto_timeouts);
+        if (ecn_on)
+            printf("flow #%d: dctcp alpha %.3f, %" PRIu64 " ecn cuts\n",
+                i, (double)c->alpha / DCTCP_ONE, st->ecn_cuts);
+    }
+}
+
+/*
+ * DCTCP on an ack carrying the server's counts: the first fresh mark of a
+ * window cuts cwnd by alpha / 2 at once, and once per window alpha moves
+ * towards the fraction of segments marked in it. Returns the new cwnd.
+ */
+static int
+dctcp_ack(size_t flow_id, const struct pkt_desc *d, int ack, int sent, int cwnd){
+    struct flow_rx *w = &rx_win[flow_id];
+    struct flow_rx_cold *c = &rx_cold[flow_id];
+
+    if (!c->ecn_seen) {
+        c->ecn_ect = d->ect;
+        c->ecn_ce = c->ecn_last_ce = d->ce;
+        c->ecn_end = sent;
+        c->ecn_cut = -1;
+        c->ecn_seen = true;
+        return cwnd;
+    }
+    bool marked = d->ece || d->ce != c->ecn_last_ce;
+    c->ecn_last_ce = d->ce;
+    if (marked && ack > c->ecn_cut && !w->in_recovery) {
+        cwnd = RTE_MAX(cwnd - (int)(((uint64_t)cwnd * c->alpha) >> (DCTCP_SHIFT + 1)), 2);
+        w->ssthresh = cwnd;
+        w->cwnd_cnt = 0;
+        c->ecn_cut = sent;
+        rx_stats[flow_id].ecn_cuts++;
+    }
+    if (ack >= c->ecn_end) {
+        uint32_t ect = d->ect - c->ecn_ect;
+        uint32_t ce = d->ce - c->ecn_ce;
+        uint32_t frac = ect ? RTE_MIN(((uint64_t)ce << DCTCP_SHIFT) / ect, (uint64_t)DCTCP_ONE) : 0;
+        c->alpha = c->alpha - (c->alpha >> DCTCP_G_SHIFT) + (frac >> DCTCP_G_SHIFT);
+        c->ecn_ect = d->ect;
+        c->ecn_ce = d->ce;
+        c->ecn_end = sent;
+    }
+    return cwnd;
+}
+
+/* RX lcore only, publishes the new window to TX */
+static void
+slide_window_ack(size_t flow_id, const struct pkt_desc *d){
+    struct flow_rx *w = &rx_win[flow_id];
+    int ack = d->ack;
+    uint16_t new_size = d->win;
+    int sent = LOAD_ACQ(tx_win[flow_id].sent_hwm); // an ack can beat TX publishing sent
+    int head = w->head;
+    int cwnd = w->cwnd;
+    int avail = w->avail;
+    uint32_t rtx_epoch = w->rtx_epoch;
+    uint32_t rto_fired = LOAD_ACQ(tx_win[flow_id].rto_fired);
+    bool done = head >= tx_win[flow_id].size;
+
+    // printf("Receive acks of #%d in flow #%d\n", ack, flow_id);
+    if (ack > sent) {
+        rx_stats[flow_id].bad_acks++;
+        return;
+    }
+    if (ack < head - 1) // reordered ack older than the window
+        return;
+
+    w->rwnd = RTE_MIN(new_size, MAX_WIN_SIZE);
+    if (rto_fired != w->rto_seen) {
+        /* the retransmission timer went off: one segment, all out is suspect (RFC 5681 3.1) */
+        w->rto_seen = rto_fired;
+        w->ssthresh = RTE_MAX((sent - head + 1) / 2, 2);
+        cwnd = 1;
+        w->cwnd_cnt = 0;
+        w->dupacks = 0;
+        w->recover = sent; // partial acks repair the next hole, NewReno style
+        w->in_recovery = true;
+    }
+    if (ack == head - 1) {
+        /* duplicate ack, only counts while data is outstanding */
+        if (sent >= head) {
+            w->dupacks++;
+            if (w->in_recovery) {
+                cwnd = RTE_MIN(cwnd + 1, MAX_CWND); // one more segment left the network
+            } else if (w->dupacks == DUPACK_THRESH && ack >= w->recover) {
+                /* NewReno fast retransmit on the third duplicate ack */
+                w->ssthresh = RTE_MAX((sent - head + 1) / 2, 2);
+                cwnd = w->ssthresh + DUPACK_THRESH;
+                w->recover = sent;
+                w->in_recovery = true;
+                STORE_REL(w->rtx_seq, head);
+                STORE_REL(w->rtx_epoch, w->rtx_epoch + 1);
+            }
         }
-        size_t header_size = 0;
-
-        uint8_t *ptr = rte_pktmbuf_mtod(pkt, uint8_t *);
-        /* add in an ethernet header */
-        eth_hdr = (struct rte_ether_hdr *)ptr;
-        
-        rte_ether_addr_copy(&my_eth, &eth_hdr->src_addr);
-        rte_ether_addr_copy(&dst, &eth_hdr->dst_addr);
-        eth_hdr->ether_type = rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4);
-        ptr += sizeof(*eth_hdr);
-        header_size += sizeof(*eth_hdr);
-
-        /* add in ipv4 header*/
-        ipv4_hdr = (struct rte_ipv4_hdr *)ptr;
-        ipv4_hdr->version_ihl = 0x45;
-        ipv4_hdr->type_of_service = 0x0;
-        ipv4_hdr->total_length = rte_cpu_to_be_16(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) + message_size);
-        ipv4_hdr->packet_id = rte_cpu_to_be_16(1);
-        ipv4_hdr->fragment_offset = 0;
-        ipv4_hdr->time_to_live = 64;
-        ipv4_hdr->next_proto_id = IPPROTO_IP;
-        ipv4_hdr->src_addr = rte_cpu_to_be_32("127.0.0.1");
-        ipv4_hdr->dst_addr = rte_cpu_to_be_32("127.0.0.1");
-
-        uint32_t ipv4_checksum = wrapsum(checksum((unsigned char *)ipv4_hdr, sizeof(struct rte_ipv4_hdr), 0));
-        // printf("Checksum is %u\n", (unsigned)ipv4_checksum);
-        ipv4_hdr->hdr_checksum = rte_cpu_to_be_32(ipv4_checksum);
-        header_size += sizeof(*ipv4_hdr);
-        ptr += sizeof(*ipv4_hdr);
-
-        // /* add in UDP hdr*/
-        // udp_hdr = (struct rte_udp_hdr *)ptr;
-        // uint16_t srcp = 5001 + flow_id;
-        // uint16_t dstp = 5001 + flow_id;
-        // udp_hdr->src_port = rte_cpu_to_be_16(srcp);
-        // udp_hdr->dst_port = rte_cpu_to_be_16(dstp);
-        // udp_hdr->dgram_len = rte_cpu_to_be_16(sizeof(struct rte_udp_hdr) + packet_len);
-
-        // uint16_t udp_cksum =  rte_ipv4_udptcp_cksum(ipv4_hdr, (void *)udp_hdr);
-
-        // // printf("Udp checksum is %u\n", (unsigned)udp_cksum);
-        // udp_hdr->dgram_cksum = rte_cpu_to_be_16(udp_cksum);
-        // ptr += sizeof(*udp_hdr);
-        // header_size += sizeof(*udp_hdr);
-
-        // LAB1 add in TCP hdr
-        tcp_hdr = (struct rte_tcp_hdr *)ptr;
-        uint16_t srcp = 5001 + flow_id;
-        uint16_t dstp = 5001 + flow_id;
-        tcp_hdr->src_port = rte_cpu_to_be_16(srcp);
-        tcp_hdr->dst_port = rte_cpu_to_be_16(dstp);
-        tcp_hdr->sent_seq = window_list[flow_id].sent + 1;               // not use a byte based but only use a 1000bytes based
-        // ignore rev_ack, client dont receive anything
-        if (tcp_hdr->sent_seq == NUM_PING - 1)
-            SET(tcp_hdr->tcp_flags, RTE_TCP_FIN_FLAG);  // last packet ends a TCP flow, farewell is ignored
-        // ignore offset, i.e. header size, it is not used 
-        // ignore rx_win, client dont receive anything
-        uint16_t tcp_cksum = rte_ipv4_udptcp_cksum(ipv4_hdr, (void *)tcp_hdr);
-
-        tcp_hdr->cksum = rte_cpu_to_be_16(tcp_cksum);
-        ptr += sizeof(*tcp_hdr);
-        header_size += sizeof(*tcp_hdr);
-
-        /* set the payload */
-        memset(ptr, 'a', packet_len);
-
-        pkt->l2_len = RTE_ETHER_HDR_LEN;
-        pkt->l3_len = sizeof(struct rte_ipv4_hdr);
-        // pkt->ol_flags = PKT_TX_IP_CKSUM | PKT_TX_IPV4;
-        pkt->data_len = header_size + packet_len;
-        pkt->pkt_len = header_size + packet_len; // since no segmentation
-        pkt->nb_segs = 1;
-        int pkts_sent = 0;
-
-        unsigned char *pkt_buffer = rte_pktmbuf_mtod(pkt, unsigned char *);
-        if (check_window(flow_id)) {
-            pkts_sent = rte_eth_tx_burst(1, 0, &pkt, 1);
-            if(pkts_sent == 1)
-            {
-                // outstanding[flow_id] ++;
-                st[tcp_hdr->sent_seq] = raw_time();
-                slide_window_onair(flow_id); //slide the window according to its seq
+    } else {
+        int newly = ack - head + 1;
+        head = ack + 1;
+        w->dupacks = 0;
+        if (w->in_recovery) {
+            if (ack >= w->recover) { // full ack, leave recovery deflated
+                cwnd = RTE_MIN(w->ssthresh, sent - head + 2);
+                w->in_recovery = false;
+            } else { // partial ack, the next hole is lost as well
+                STORE_REL(w->rtx_seq, head);
+                STORE_REL(w->rtx_epoch, w->rtx_epoch + 1);
+                cwnd = RTE_MAX(cwnd - newly + 1, 1);
+            }
+        } else if (cwnd < w->ssthresh) {
+            cwnd = RTE_MIN(cwnd + newly, MAX_CWND); // slow start
+        } else {
+            w->cwnd_cnt += newly; // congestion avoidance
+            if (w->cwnd_cnt >= cwnd) {
+                w->cwnd_cnt -= cwnd;
+                cwnd = RTE_MIN(cwnd + 1, MAX_CWND);
             }
         }
-        
-        // uint64_t last_sent = rte_get_timer_cycles();
-        // printf("Sent packet at %u, %d is outstanding, intersend is %u\n", (unsigned)last_sent, outstanding, (unsigned)intersend_time);
-        receive_once();
-        rte_pktmbuf_free(pkt);
-        flow_id = (flow_id+1) % flow_num;
     }
-    // printf("Sent %"PRIu64" packets.\n", reqs);
-    // dump_latencies(&latency_dist);
-    // return 0;
 
+    if (d->ecn_opt)
+        cwnd = dctcp_ack(flow_id, d, ack, sent, cwnd);
+
+    /* usable window is the smaller of what the receiver and the network allow */
+    snap_write_begin(w);
+    STORE_REL(w->head, head);
+    STORE_REL(w->cwnd, cwnd);
+    STORE_REL(w->avail, head - 1 + RTE_MIN(w->rwnd, cwnd));
+    snap_write_end(w);
+    if (w->avail != avail || w->rtx_epoch != rtx_epoch)
+        wake_flow(flow_id); // TX has more to send or to repair
+    if (!done && head >= tx_win[flow_id].size)
+        STORE_REL(acked_flows, acked_flows + 1);
 }
 
-static inline void
-window_status(){
-    // printf("\n");
-    // for (int i=0; i<flow_num; i++){
-    //     printf("flow #%d:", i);
-    //     for (int j=0; j<window_list[i].head; j++) printf("*");
-    //     for (int j=window_list[i].head; j<=window_list[i].sent; j++) printf("o");
-    //     for (int j=window_list[i].sent+1; j<=window_list[i].avail; j++) printf("-");
-    //     printf("\n");
-    // }
-    // printf("\n");
+/* RX lcore only, the response to the request ending at seq end_seq */
+static void
+rpc_response(size_t flow_id, int end_seq){
+    struct flow_rx_cold *c = &rx_cold[flow_id];
+    int req = end_seq / rpc_segs;
+
+    if (req < c->rpc_done || (end_seq + 1) % rpc_segs != 0 || end_seq > LOAD_ACQ(tx_win[flow_id].sent_hwm))
+        return; // duplicate, or nothing we asked for
+    rx_stats[flow_id].rpc_lost += req - c->rpc_done;
+    hist_add(&rpc_lat, rte_rdtsc() - LOAD_ACQ(rpc_issue[flow_id * RPC_RING + req % RPC_RING]));
+    STORE_REL(c->rpc_done, req + 1);
+    wake_flow(flow_id); // releases the next request in closed loop
+}
+
+/* TX side, (re)start the retransmission timer of flow_id from now */
+static void
+rto_arm(size_t flow_id, uint64_t now){
+    struct flow_tx_cold *tc = &tx_cold[flow_id];
+
+    tc->rto_head = LOAD_ACQ(rx_win[flow_id].head);
+    flowq_wheel_arm(&sched_timers, RTO_TIMER(flow_id),
+                    now + (LOAD_ACQ(rx_stats[flow_id].rto) << tc->rto_backoff));
+}
+
+/*
+ * TX side, RFC 6298: nothing acked for an RTO, the segment at head goes
+ * out again whatever the window and RX collapses cwnd on the next ack. The
+ * timer is armed when data leaves with none out and restarts lazily: it
+ * only fires if head has not moved since it was armed, otherwise it is
+ * armed again from now. Each expiry doubles the next one.
+ */
+static void
+rto_timeout(size_t flow_id, uint64_t now){
+    struct flow_tx *t = &tx_win[flow_id];
+    struct flow_tx_cold *tc = &tx_cold[flow_id];
+    int head = LOAD_ACQ(rx_win[flow_id].head);
+
+    if (head > t->sent) {
+        tc->rto_backoff = 0; // all acked, the next segment arms it
+        return;
+    }
+    if (head != tc->rto_head) {
+        tc->rto_backoff = 0;
+        rto_arm(flow_id, now);
+        return;
+    }
+    t->rto_seq = head;
+    tc->rto_backoff = RTE_MIN(tc->rto_backoff + 1, RTO_MAX_BACKOFF);
+    STORE_REL(t->rto_fired, t->rto_fired + 1);
+    tx_stats[flow_id].rto_timeouts++;
+    rto_arm(flow_id, now);
+    sched_queue(flow_id);
 }
 
+/*
+ * TX side: a lost response would stall a closed loop flow forever, so the
+ * oldest request whose data the server acked RPC_TIMEOUT_MS ago without
+ * answering is given up on. Its response still counts if it shows up.
+ * The flow's timer runs while a request is out: armed when the first one
+ * goes, it moves on to the next one from here.
+ */
+static void
+rpc_timeout(size_t flow_id, uint64_t now){
+    int req = rpc_finished(flow_id);
+    int end = (req + 1) * rpc_segs - 1;
+    uint64_t due;
+
+    if (end > tx_win[flow_id].sent)
+        return; // nothing out, the next request arms it again
+    due = rpc_issue[flow_id * RPC_RING + req % RPC_RING] + rte_get_tsc_hz() / 1000 * RPC_TIMEOUT_MS;
+    if (now < due) {
+        flowq_wheel_arm(&sched_timers, RPC_TIMER(flow_id), due);
+        return;
+    }
+    if (LOAD_ACQ(rx_win[flow_id].head) <= end) { // not acked yet, retransmissions are on it
+        flowq_wheel_arm(&sched_timers, RPC_TIMER(flow_id), now + rte_get_tsc_hz() / 1000);
+        return;
+    }
+    tx_win[flow_id].rpc_expired = req + 1;
+    tx_stats[flow_id].rpc_timeouts++;
+    sched_queue(flow_id);
+    flowq_wheel_arm(&sched_timers, RPC_TIMER(flow_id), now); // the next request, if one is out
+}
 
+/* latency percentiles over every answered request */
 static void
-receive_once() {
+rpc_summary(){
+    double us = 1e6 / rte_get_tsc_hz();
+    uint64_t reqs = 0, lost = 0, timeouts = 0;
+
+    for (int i = 0; i < flow_num; i++) {
+        int nreq = tx_win[i].size / rpc_segs;
+        reqs += nreq;
+        lost += rx_stats[i].rpc_lost + nreq - rx_cold[i].rpc_done;
+        timeouts += tx_stats[i].rpc_timeouts;
+    }
+    printf("rpc: %" PRIu64 " requests, %" PRIu64 " answered, %" PRIu64 " lost (%" PRIu64 " timed out)\n",
+           reqs, rpc_lat.count, lost, timeouts);
+    if (rpc_lat.count == 0)
+        return;
+    printf("rpc latency: mean %.2fus p50 %.2fus p90 %.2fus p99 %.2fus p99.9 %.2fus max %.2fus\n",
+           (double)rpc_lat.sum / rpc_lat.count * us, hist_quantile(&rpc_lat, 0.5) * us,
+           hist_quantile(&rpc_lat, 0.9) * us, hist_quantile(&rpc_lat, 0.99) * us,
+           hist_quantile(&rpc_lat, 0.999) * us, rpc_lat.max * us);
+}
+
+/* new segments the next super-frame of flow_id may carry, bounded by window, flow end and RPC load */
+static inline int
+burst_segs(size_t flow_id){
+    int next = tx_win[flow_id].sent + 1;
+    int n = RTE_MIN(LOAD_ACQ(rx_win[flow_id].avail) - tx_win[flow_id].sent, remaining(flow_id));
+    if (rpc_req_bytes) // a super-frame ends with its request, PSH sits on the last segment
+        n = RTE_MIN(n, RTE_MIN(rpc_limit(flow_id) - next, rpc_segs - next % rpc_segs));
+    if (file_data != NULL && n > 1 && next + n == tx_win[flow_id].size)
+        n--; // the FIN goes alone, segmentation would copy its CRC option onto every segment
+    return RTE_MAX(1, RTE_MIN(n, max_segs));
+}
+
+/* fill len payload bytes behind the headers from src, 'a's without one, chaining mbufs once one is full */
+static int
+append_payload(struct rte_mbuf *pkt, uint32_t len, const uint8_t *src)
+{
+    struct rte_mbuf *last = pkt;
+
+    while (len) {
+        if (rte_pktmbuf_tailroom(last) == 0) {
+            struct rte_mbuf *m = pool_alloc();
+            if (m == NULL || rte_pktmbuf_chain(pkt, m) != 0) {
+                rte_pktmbuf_free(m);
+                return -ENOMEM;
+            }
+            last = m;
+        }
+        uint16_t n = RTE_MIN((uint32_t)rte_pktmbuf_tailroom(last), len);
+        char *dst = rte_pktmbuf_append(pkt, n);
+        if (src != NULL) {
+            memcpy(dst, src, n);
+            src += n;
+        } else {
+            memset(dst, 'a', n);
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/* len bytes of the file from off behind the headers, an external buffer when the mapping is DMA mapped */
+static int
+file_payload(size_t flow_id, struct rte_mbuf *pkt, uint32_t off, uint32_t len)
+{
+    if (!file_zerocopy)
+        return append_payload(pkt, len, file_data + off);
+
+    struct rte_mbuf *m = pool_alloc();
+    if (m == NULL)
+        return -ENOMEM;
+    rte_mbuf_ext_refcnt_update(&file_shinfo[flow_id], 1);
+    // IOVA as VA, checked when the mapping was registered
+    rte_pktmbuf_attach_extbuf(m, file_data + off, (rte_iova_t)(uintptr_t)(file_data + off),
+                              (uint16_t)len, &file_shinfo[flow_id]);
+    m->data_len = len;
+    m->pkt_len = len;
+    if (rte_pktmbuf_chain(pkt, m) != 0) {
+        rte_pktmbuf_free(m);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/* checksums of a frame leaving without offload, payload may be chained */
+static inline void
+sw_cksum(struct rte_mbuf *m)
+{
+    struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, m->l2_len);
+    struct rte_tcp_hdr *tcp = rte_pktmbuf_mtod_offset(m, struct rte_tcp_hdr *, m->l2_len + m->l3_len);
+
+    ip->hdr_checksum = 0;
+    ip->hdr_checksum = cksum_ipv4_hdr(ip);
+    tcp->cksum = 0;
+    // already in wire order, no swap
+    tcp->cksum = cksum_ipv4_l4_mbuf(ip, m, m->l2_len + m->l3_len, m->pkt_len - m->l2_len - m->l3_len);
+}
+
+/*
+ * The NIC cannot segment: rte_gso cuts the super-frame into indirect mbufs
+ * sharing its payload, so headers are still built once per run. Returns
+ * how many segments, in order, made it onto the ring.
+ */
+static uint16_t
+tx_gso(uint16_t port, uint16_t queue, struct rte_mbuf *pkt)
+{
+    struct rte_mbuf *segs[TSO_MAX_SEGS];
+    int n = rte_gso_segment(pkt, &gso_ctx, segs, TSO_MAX_SEGS);
+
+    rte_pktmbuf_free(pkt); // the segments hold their own references
+    if (n <= 0)
+        return 0;
+    PROBE_MARK(ST_GSO, n);
+    for (int i = 0; i < n; i++) {
+        segs[i]->ol_flags = 0;
+        sw_cksum(segs[i]);
+    }
+    PROBE_MARK(ST_CKSUM, n);
+    uint16_t nb_tx = pktio_tx_burst(port, queue, segs, n);
+    PROBE_MARK(ST_TX, nb_tx);
+    for (int i = nb_tx; i < n; i++)
+        rte_pktmbuf_free(segs[i]);
+    return nb_tx;
+}
+
+/*
+ * build the next frame of flow_id and put it on the wire, retransmissions
+ * first. New data goes out as a super-frame of up to max_segs segments that
+ * the NIC (TSO) or rte_gso splits, so seq on the wire is a byte offset that
+ * segmentation can advance. Template over the segment size and whether
+ * segmentation is on, see the variants below.
+ */
+static __rte_always_inline int
+send_packet_tmpl(size_t flow_id, const uint32_t plen, const bool seg)
+{
+    uint32_t rtx_epoch;
+    int seq = rtx_next(flow_id, &rtx_epoch);
+    bool rtx = seq >= 0;
+    if (!rtx)
+        seq = tx_win[flow_id].sent + 1;
+    int nseg = rtx || !seg ? 1 : burst_segs(flow_id);
+    bool fin = seq + nseg == tx_win[flow_id].size;
+    uint16_t opt_len = sizeof(struct tcp_ts_opt) + (fin && file_data != NULL ? sizeof(struct tcp_crc_opt) : 0);
+    uint32_t payload = (uint32_t)nseg * plen;
+    if (file_data != NULL) // the last segment carries what is left of the file
+        payload = RTE_MIN(payload, (uint32_t)(file_size - (size_t)seq * plen));
+    struct rte_mbuf *pkt;
+    struct rte_ether_hdr *eth_hdr;
+    struct rte_ipv4_hdr *ipv4_hdr;
+    struct rte_tcp_hdr *tcp_hdr;
+
+    uint16_t port = tx_cold[flow_id].port;
+    uint16_t queue = tx_cold[flow_id].queue;
+
+    pkt = pool_alloc();
+    if (pkt == NULL)
+        return -ENOMEM; // counted, the caller drains acks and tries again
+    size_t header_size = 0;
+
+    uint8_t *ptr = rte_pktmbuf_mtod(pkt, uint8_t *);
+    /* add in an ethernet header */
+    eth_hdr = (struct rte_ether_hdr *)ptr;
+    
+    rte_ether_addr_copy(&my_eth[port], &eth_hdr->src_addr);
+    rte_ether_addr_copy(&dst_eth[port], &eth_hdr->dst_addr);
+    eth_hdr->ether_type = rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4);
+    ptr += sizeof(*eth_hdr);
+    header_size += sizeof(*eth_hdr);
+
+    /* add in ipv4 header*/
+    ipv4_hdr = (struct rte_ipv4_hdr *)ptr;
+    ipv4_hdr->version_ihl = 0x45;
+    ipv4_hdr->type_of_service = flow_tos(flow_id, rtx);
+    ipv4_hdr->total_length = rte_cpu_to_be_16(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr)
+                                              + opt_len + payload);
+    ipv4_hdr->packet_id = rte_cpu_to_be_16(1);
+    ipv4_hdr->fragment_offset = 0;
+    ipv4_hdr->time_to_live = 64;
+    ipv4_hdr->next_proto_id = IP_PROTO;
+    ipv4_hdr->src_addr = RTE_BE32(IP_ADDR);
+    ipv4_hdr->dst_addr = RTE_BE32(IP_ADDR);
+    ipv4_hdr->hdr_checksum = 0;
+    header_size += sizeof(*ipv4_hdr);
+    ptr += sizeof(*ipv4_hdr);
+
+    // LAB1 add in TCP hdr
+    tcp_hdr = (struct rte_tcp_hdr *)ptr;
+    uint16_t srcp = FLOW_PORT_BASE + (flow_id >> FLOW_PORT_BITS);
+    uint16_t dstp = FLOW_PORT_BASE + (flow_id & ((1 << FLOW_PORT_BITS) - 1));
+    tcp_hdr->src_port = rte_cpu_to_be_16(srcp);
+    tcp_hdr->dst_port = rte_cpu_to_be_16(dstp);
+    tcp_hdr->sent_seq = rte_cpu_to_be_32((uint32_t)seq * plen); // segment index * MSS
+    tcp_hdr->recv_ack = 0; // the server's responses are not acked
+    tcp_hdr->tcp_flags = 0;
+    if (fin)
+        SET(tcp_hdr->tcp_flags, RTE_TCP_FIN_FLAG);  // last packet ends a TCP flow, segmentation keeps it on the last one
+    if (rpc_req_bytes && (seq + nseg) % rpc_segs == 0)
+        SET(tcp_hdr->tcp_flags, RTE_TCP_PSH_FLAG); // ends a request, kept on the last segment too
+    if (rpc_req_bytes && !rtx && seq % rpc_segs == 0) {
+        int req = seq / rpc_segs;
+        // open loop measures from when the request was due, not when the window let it out
+        uint64_t issue = rpc_gap ? rpc_t0 + req * rpc_gap : rte_rdtsc();
+        STORE_REL(rpc_issue[flow_id * RPC_RING + req % RPC_RING], issue);
+        if (!flowq_wheel_armed(&sched_timers, RPC_TIMER(flow_id)))
+            flowq_wheel_arm(&sched_timers, RPC_TIMER(flow_id), issue + rte_get_tsc_hz() / 1000 * RPC_TIMEOUT_MS);
+    }
+    tcp_hdr->data_off = (sizeof(*tcp_hdr) + opt_len) / 4 << 4;
+    tcp_hdr->rx_win = 0; // nothing but acks and responses flows back
+    tcp_hdr->cksum = 0;
+    tcp_hdr->tcp_urp = 0;
+    ptr += sizeof(*tcp_hdr);
+    header_size += sizeof(*tcp_hdr);
+
+    /* stamp the send time, the server echoes it back in tsecr */
+    struct tcp_ts_opt *ts = (struct tcp_ts_opt *)ptr;
+    ts->nop[0] = ts->nop[1] = TCP_OPT_NOP;
+    ts->kind = TCP_OPT_TS;
+    ts->len = TCP_OPT_TS_LEN;
+    ts->tsval = rte_cpu_to_be_32(ts_now());
+    ts->tsecr = 0;
+    ptr += sizeof(*ts);
+    header_size += sizeof(*ts);
+    if (opt_len > sizeof(*ts)) { // file mode lets the server verify what it wrote
+        struct tcp_crc_opt *crc = (struct tcp_crc_opt *)ptr;
+        crc->nop[0] = crc->nop[1] = TCP_OPT_NOP;
+        crc->kind = TCP_OPT_CRC;
+        crc->len = TCP_OPT_CRC_LEN;
+        crc->crc = rte_cpu_to_be_32(file_crc);
+        ptr += sizeof(*crc);
+        header_size += sizeof(*crc);
+    }
+
+    pkt->data_len = header_size;
+    pkt->pkt_len = header_size;
+    pkt->l2_len = RTE_ETHER_HDR_LEN;
+    pkt->l3_len = sizeof(struct rte_ipv4_hdr);
+    pkt->l4_len = sizeof(*tcp_hdr) + opt_len;
+
+    /* set the payload */
+    if ((file_data != NULL ? file_payload(flow_id, pkt, (uint32_t)seq * plen, payload)
+                           : append_payload(pkt, payload, NULL)) != 0) {
+        rte_pktmbuf_free(pkt);
+        return -ENOMEM;
+    }
+
+    /*
+     * With an RX lcore the ack of a segment can arrive before sent moves
+     * past it, so the segments go on record before the NIC sees them and
+     * the record shrinks back to sent if some of them did not make it.
+     */
+    if (!rtx)
+        STORE_REL(tx_win[flow_id].sent_hwm, seq + nseg - 1);
+
+    uint16_t nb_tx;
+    PROBE_MARK(ST_BUILD, nseg);
+    if (nseg == 1) {
+        sw_cksum(pkt);
+        PROBE_MARK(ST_CKSUM, 1);
+        nb_tx = pktio_tx_burst(port, queue, &pkt, 1);
+        PROBE_MARK(ST_TX, nb_tx);
+    } else {
+        pkt->ol_flags = RTE_MBUF_F_TX_TCP_SEG | RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM;
+        pkt->tso_segsz = plen;
+        if (tso_hw[port]) {
+            // the NIC wants the pseudo header sum without length, it fills in the rest per segment
+            tcp_hdr->cksum = rte_ipv4_phdr_cksum(ipv4_hdr, pkt->ol_flags);
+            PROBE_MARK(ST_CKSUM, nseg);
+            nb_tx = rte_eth_tx_burst(port, queue, &pkt, 1) * nseg; // only ethdev ports do TSO
+            PROBE_MARK(ST_TX, nb_tx);
+        } else {
+            nb_tx = tx_gso(port, queue, pkt);
+            pkt = NULL;
+        }
+    }
+
+    if (nb_tx > 0) {
+        if (rtx) {
+            tx_win[flow_id].rtx_epoch = rtx_epoch;
+            if (seq == tx_win[flow_id].rto_seq)
+                tx_win[flow_id].rto_seq = -1;
+            tx_stats[flow_id].retransmits++;
+        } else {
+            slide_window_onair(flow_id, nb_tx); //slide the window over what made it out
+            if (!flowq_wheel_armed(&sched_timers, RTO_TIMER(flow_id)))
+                rto_arm(flow_id, rte_rdtsc());
+            if (!check_window(flow_id))
+                tx_stats[flow_id].win_stalls++;
+        }
+        wfq_account(flow_id, nb_tx);
+    } else if (pkt != NULL) {
+        rte_pktmbuf_free(pkt); // the driver owns the mbuf only once it is sent
+    }
+    if (!rtx && nb_tx < nseg)
+        STORE_REL(tx_win[flow_id].sent_hwm, tx_win[flow_id].sent);
+    return 0;
+}
+
+static __rte_always_inline uint16_t
+receive_port_tmpl(uint16_t port, const uint32_t plen) {
     uint16_t nb_rx;
-    struct rte_mbuf *r_pkts[BURST_SIZE];
-    uint64_t ret;
-    // LAB1: receiving packets should be implemented in another thread
+    struct rte_mbuf *r_pkts[TUNE_MAX_BURST];
     /* now poll on receiving packets */
 
     nb_rx = 0;
-    nb_rx = rte_eth_rx_burst(1, 0, r_pkts, BURST_SIZE);
+    PROBE_BEGIN();
+    nb_rx = pktio_rx_burst(port, 0, r_pkts, io_params.burst);
     if (nb_rx == 0) {
         // printf("nothing reveived.\n");
-        return;
+        return 0;
     }
+    PROBE_MARK(ST_RX, nb_rx);
+
+    struct pkt_desc desc[TUNE_MAX_BURST];
+    parse_burst(port, r_pkts, nb_rx, desc, plen);
+    PROBE_MARK(ST_PARSE, nb_rx);
 
     for (int i = 0; i < nb_rx; i++) {
-        struct sockaddr_in src, dst;
-        // void *payload = NULL;
-        // size_t payload_length = 0;
-        int ack_seq;
-        int window;
-        int index = parse_packet(&src, &dst, &ack_seq, &window, r_pkts[i]);
-        int flow_id = index - 1;
-        if (index != 0) {
-            slide_window_ack(flow_id, ack_seq, window);  // slide and resize the window according to ack （ack: ack+window）
+        int flow_id = desc[i].flow_id;
+        if (flow_id >= 0 && desc[i].rsp >= 0 && rpc_req_bytes) {
+            rpc_response(flow_id, desc[i].rsp); // window work is left to the ack before it
+        } else if (flow_id >= 0) {
+            if (desc[i].tsecr != 0)
+                rtt_sample(flow_id, desc[i].tsecr);
+            slide_window_ack(flow_id, &desc[i]);  // slide and resize the window according to ack （ack: ack+window）
                                         // resize by the window in the ack, not a fix number
-            rt[ack_seq] = raw_time();
         }
-        rte_pktmbuf_free(r_pkts[i]);
     }
-    window_status();
+    wake_flush();
+    PROBE_MARK(ST_WINDOW, nb_rx);
+    rte_pktmbuf_free_bulk(r_pkts, nb_rx);
+    PROBE_MARK(ST_FREE, nb_rx);
+    return nb_rx;
 }
 
-static void
-lcore_main_rev(__rte_unused void *arg)
+/* one sweep over every link, acks of a flow come back on the port it sends on */
+static __rte_always_inline uint16_t
+receive_once_tmpl(const uint32_t plen) {
+    uint16_t nb_rx = 0;
+
+    for (uint16_t p = 0; p < nb_used_ports; p++)
+        nb_rx += receive_port_tmpl(used_ports[p], plen);
+    return nb_rx;
+}
+
+typedef uint16_t (*receive_once_t)(void);
+
+/* TX polls acks itself unless a dedicated RX lcore does */
+static __rte_always_inline void
+poll_acks(const receive_once_t rx){
+    if (rx_lcore == RTE_MAX_LCORE)
+        rx();
+    else
+        rte_pause();
+}
+
+/*
+ * The TX loop, template over the segment size, segmentation and the
+ * matching copy of the ack path, see the variants below.
+ */
+static __rte_always_inline int
+lcore_main_tmpl(const uint32_t plen, const bool seg, const receive_once_t rx)
 {
-    uint16_t nb_rx;
-    struct rte_mbuf *r_pkts[BURST_SIZE];
-    // LAB1: receiving packets should be implemented in another thread
-    /* now poll on receiving packets */
+    rpc_t0 = rte_rdtsc();
+    sched_start();
     for (;;) {
-        window_status();
-        nb_rx = 0;
-        for (;;) {
-            nb_rx = rte_eth_rx_burst(1, 0, r_pkts, BURST_SIZE);
-            if (nb_rx == 0) {
-                printf("nothing reveived.\n");
-                sleep(1);
-                continue;
-            }
+        PROBE_BEGIN();
+        int flow_id = pick_flow();
+        PROBE_MARK(ST_PICK, flow_id >= 0);
+        if (flow_id < 0) {
+            if (all_acked()) // retransmissions may be needed until the very last ack
+                break;
+            poll_acks(rx); // every unfinished flow is blocked by its window or RPC load
+            continue;
+        }
+        int ret = send_packet_tmpl(flow_id, plen, seg);
+        sched_queue(flow_id); // back in line if it has more to send
+        if (ret != 0) {
+            poll_acks(rx); // pool ran dry, give the NIC time to complete tx
+            continue;
         }
+        if (rx_lcore == RTE_MAX_LCORE)
+            rx();
+    }
+    return 0;
+}
 
-        printf("Receive %u acks\n", (unsigned)nb_rx);
-        for (int i = 0; i < nb_rx; i++) {
-            struct sockaddr_in src, dst;
-            // void *payload = NULL;
-            // size_t payload_length = 0;
-            int ack_seq;
-            int window;
-            int index = parse_packet(&src, &dst, &ack_seq, &window, r_pkts[i]);
-            int flow_id = index - 1;
-            if (index != 0) 
-                slide_window_ack(flow_id, ack_seq, window);  // slide and resize the window according to ack （ack: ack+window）
-                                            // resize by the window in the ack, not a fix number
-            rte_pktmbuf_free(r_pkts[i]);
+/* standalone RX lcore, acks are handled off the sending core */
+static __rte_always_inline int
+lcore_main_rev_tmpl(const receive_once_t rx)
+{
+    struct rx_idle idle;
+
+    // acks come in bursts behind the window, idle in between
+    rx_idle_init(&idle, &idle_conf);
+    for (uint16_t p = 0; p < nb_used_ports; p++)
+        rx_idle_add(&idle, used_ports[p], 0, rx_intr[used_ports[p]]);
+    while (!all_acked())
+        rx_idle_update(&idle, rx());
+    printf("rx lcore slept %" PRIu64 " times, %" PRIu64 " timed out\n",
+           idle.sleeps, idle.timeouts);
+    return 0;
+}
 
-        }
+/*
+ * One copy of the loops per segment size and segmentation setting, size 0
+ * reads packet_len. Sending, ack parsing and the byte to segment math
+ * inline into them, so the copy is picked once and nothing inside calls
+ * through a pointer or divides by a runtime size.
+ */
+#define RECEIVE_VARIANT(plen, unused) \
+static uint16_t \
+receive_once_##plen(void) \
+{ \
+    return receive_once_tmpl(plen ? plen : (uint32_t)packet_len); \
+} \
+static int \
+lcore_main_rev_##plen(__rte_unused void *arg) \
+{ \
+    return lcore_main_rev_tmpl(receive_once_##plen); \
+}
+#define LCORE_VARIANT(plen, seg) \
+static int \
+lcore_main_##plen##_##seg(void) \
+{ \
+    return lcore_main_tmpl(plen ? plen : (uint32_t)packet_len, seg, receive_once_##plen); \
+}
+RECEIVE_VARIANT(0, 0)
+LCORE_VARIANT(0, 0)
+LCORE_VARIANT(0, 1)
+DATAPATH_SEG_SIZES(RECEIVE_VARIANT, 0)
+DATAPATH_SEG_SIZES(LCORE_VARIANT, 0)
+DATAPATH_SEG_SIZES(LCORE_VARIANT, 1)
+
+#define LCORE_ENTRY(plen, unused) \
+    { plen, { lcore_main_##plen##_0, lcore_main_##plen##_1 }, lcore_main_rev_##plen, receive_once_##plen },
+static const struct {
+    uint32_t plen;
+    int (*tx[2])(void); // by segmentation
+    lcore_function_t *rev;
+    receive_once_t rx;
+} lcore_variants[] = {
+    DATAPATH_SEG_SIZES(LCORE_ENTRY, 0)
+    LCORE_ENTRY(0, 0) // generic, keep last
+};
+
+static int (*lcore_main)(void) = lcore_main_0_0;
+static lcore_function_t *lcore_main_rev = lcore_main_rev_0;
+static receive_once_t receive_once = receive_once_0; // the drain after the TX loop
+
+/* pick the loops for -l and the TSO/GSO limit once they are known */
+static void
+datapath_select(void)
+{
+    bool seg = max_segs > 1;
+    unsigned int v;
+
+    for (v = 0; v < RTE_DIM(lcore_variants) - 1; v++)
+        if (lcore_variants[v].plen == (uint32_t)packet_len)
+            break;
+    lcore_main = lcore_variants[v].tx[seg];
+    lcore_main_rev = lcore_variants[v].rev;
+    receive_once = lcore_variants[v].rx;
+    if (lcore_variants[v].plen != 0)
+        printf("datapath: specialized for %d byte segments, segmentation %s\n",
+               packet_len, seg ? "on" : "off");
+    else
+        printf("datapath: generic, no copy for %d byte segments\n", packet_len);
+    printf("datapath: %s checksum\n", cksum_impl_name());
+}
 
-        for (int i=0; i<flow_num; i++) {
-            if (window_list[i].head < NUM_PING)
-                goto keep;
+/*
+ * Telemetry callbacks run on the telemetry thread, they read the flow
+ * arrays the lcores keep anyway. Totals walk every flow, so they cost the
+ * reader and not the datapath.
+ */
+static int
+tel_flows(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+    uint64_t sent = 0, acked = 0, rtx = 0, stalls = 0;
+
+    for (int i = 0; i < flow_num; i++) {
+        sent += LOAD_ACQ(tx_win[i].sent) + 1;
+        acked += LOAD_ACQ(rx_win[i].head);
+        rtx += LOAD_ACQ(tx_stats[i].retransmits);
+        stalls += LOAD_ACQ(tx_stats[i].win_stalls);
+    }
+    rte_tel_data_start_dict(d);
+    rte_tel_data_add_dict_uint(d, "flows", flow_num);
+    rte_tel_data_add_dict_uint(d, "acked_flows", LOAD_ACQ(acked_flows));
+    rte_tel_data_add_dict_uint(d, "segments_sent", sent);
+    rte_tel_data_add_dict_uint(d, "segments_acked", acked);
+    rte_tel_data_add_dict_uint(d, "bytes_acked", acked * packet_len);
+    rte_tel_data_add_dict_uint(d, "retransmits", rtx);
+    rte_tel_data_add_dict_uint(d, "window_stalls", stalls);
+    return 0;
+}
+
+/* window and congestion state of one flow */
+static int
+tel_flow(const char *cmd __rte_unused, const char *params, struct rte_tel_data *d)
+{
+    double us = 1e6 / rte_get_tsc_hz();
+    struct win_snapshot ws;
+    char *end;
+
+    if (params == NULL || *params == '\0')
+        return -1;
+    long i = strtol(params, &end, 10);
+    if (*end != '\0' || i < 0 || i >= flow_num)
+        return -1;
+    window_snapshot(i, &ws);
+    rte_tel_data_start_dict(d);
+    rte_tel_data_add_dict_int(d, "sent", ws.sent);
+    rte_tel_data_add_dict_int(d, "head", ws.head);
+    rte_tel_data_add_dict_int(d, "avail", ws.avail);
+    rte_tel_data_add_dict_int(d, "cwnd", ws.cwnd);
+    rte_tel_data_add_dict_int(d, "size", tx_win[i].size);
+    rte_tel_data_add_dict_uint(d, "retransmits", LOAD_ACQ(tx_stats[i].retransmits));
+    rte_tel_data_add_dict_uint(d, "rto_timeouts", LOAD_ACQ(tx_stats[i].rto_timeouts));
+    rte_tel_data_add_dict_uint(d, "window_stalls", LOAD_ACQ(tx_stats[i].win_stalls));
+    rte_tel_data_add_dict_uint(d, "srtt_ns", LOAD_ACQ(rx_win[i].srtt) * us * 1000);
+    rte_tel_data_add_dict_uint(d, "rto_ns", LOAD_ACQ(rx_stats[i].rto) * us * 1000);
+    rte_tel_data_add_dict_uint(d, "bad_acks", LOAD_ACQ(rx_stats[i].bad_acks));
+    if (ecn_on) {
+        rte_tel_data_add_dict_uint(d, "dctcp_alpha_permille", LOAD_ACQ(rx_cold[i].alpha) * 1000 / DCTCP_ONE);
+        rte_tel_data_add_dict_uint(d, "ecn_cuts", LOAD_ACQ(rx_stats[i].ecn_cuts));
+    }
+    return 0;
+}
+
+static void
+tel_hist(struct rte_tel_data *d, const char *prefix, const struct hist *h)
+{
+    static const struct { const char *name; double q; } pct[] = {
+        { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 },
+    };
+    double ns = 1e9 / rte_get_tsc_hz();
+    char name[32];
+
+    snprintf(name, sizeof(name), "%s_count", prefix);
+    rte_tel_data_add_dict_uint(d, name, h->count);
+    for (unsigned int k = 0; k < RTE_DIM(pct); k++) {
+        snprintf(name, sizeof(name), "%s_%s_ns", prefix, pct[k].name);
+        rte_tel_data_add_dict_uint(d, name, hist_quantile(h, pct[k].q) * ns);
+    }
+    snprintf(name, sizeof(name), "%s_max_ns", prefix);
+    rte_tel_data_add_dict_uint(d, name, h->max * ns);
+}
+
+/* rtt and RPC latency percentiles, read while RX adds to them, monitoring tolerates a torn bucket */
+static int
+tel_latency(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+    rte_tel_data_start_dict(d);
+    tel_hist(d, "rtt", &rtt_hist);
+    if (rpc_req_bytes)
+        tel_hist(d, "rpc", &rpc_lat);
+    return 0;
+}
+
+static void
+usage(const char *prgname)
+{
+    printf("usage: %s [EAL options] -- <flow_num> <flow_size[,flow_size...]>\n"
+           "  -I IO       packet I/O: dpdk (default, AF_XDP through --vdev net_af_xdp0,iface=IF)\n"
+           "              or afpacket:IF[,IF...] on kernel interfaces, run the EAL with --no-pci\n"
+           "  -p POLICY   flow scheduling: rr (default), srf, wfq, prio\n"
+           "  -w W[,W...] per flow WFQ weights, the last one repeats\n"
+           "  -c C[,C...] per flow priority classes 0 (highest) - %d\n"
+           "  -m P=MAC    server MAC behind port P, repeatable\n"
+           "  -l LEN      payload bytes per segment (default 1000), same on the server\n"
+           "  -M MTU      port MTU up to 9000 (default 1500)\n"
+           "  -T BYTES    payload per TSO/GSO super-frame (default 65536), below two segments disables it\n"
+           "  -f FILE     stream FILE on every flow instead of flow_size 'a's, the server checks its crc\n"
+           "  -R BYTES    RPC mode, flows are requests of BYTES each, flow_size counts bytes of requests\n"
+           "  -O N        closed loop: requests outstanding per flow (default 1)\n"
+           "  -o RATE     open loop: requests per second per flow, overrides -O\n"
+           "  -r B,P,S    rx idling: busy polls, pause us, epoll sleep ms (0 never sleeps)\n"
+           "  -E          ECN: data leaves ECT(0), CE marks the server echoes cut cwnd (DCTCP)\n"
+           "  -B B,R,T,C  burst, rx ring, tx ring, mbuf cache (default 32,1024,1024,250)\n"
+           "  -A TARGET   sweep -B at startup on loop (net_ring vdev) or a port id in MAC loopback\n"
+           "  -K          benchmark the checksum implementations and exit\n",
+           prgname, PRIO_CLASSES - 1);
+}
+
+static int
+parse_args(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "I:p:w:c:m:l:M:T:f:R:O:o:r:B:A:EK")) != -1) {
+        switch (opt) {
+        case 'I':
+            if (pktio_parse(optarg) != 0)
+                return -1;
+            break;
+        case 'p':
+            if (!strcmp(optarg, "rr"))
+                policy = POLICY_RR;
+            else if (!strcmp(optarg, "srf"))
+                policy = POLICY_SRF;
+            else if (!strcmp(optarg, "wfq"))
+                policy = POLICY_WFQ;
+            else if (!strcmp(optarg, "prio"))
+                policy = POLICY_PRIO;
+            else
+                return -1;
+            break;
+        case 'w':
+            flow_weights = optarg;
+            break;
+        case 'c':
+            flow_classes = optarg;
+            break;
+        case 'm': {
+            char *mac;
+            long port = strtol(optarg, &mac, 10);
+            if (*mac != '=' || port < 0 || port >= RTE_MAX_ETHPORTS ||
+                rte_ether_unformat_addr(mac + 1, &dst_eth[port]) != 0)
+                return -1;
+            break;
         }
-        break;
-        keep: {}
+        case 'l':
+            packet_len = atoi(optarg);
+            break;
+        case 'M':
+            mtu = (uint16_t) atoi(optarg);
+            break;
+        case 'T':
+            tso_bytes = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            file_path = optarg;
+            break;
+        case 'R':
+            rpc_req_bytes = atoi(optarg);
+            if (rpc_req_bytes < 1)
+                return -1;
+            break;
+        case 'O':
+            rpc_outstanding = atoi(optarg);
+            if (rpc_outstanding < 1 || rpc_outstanding > RPC_RING)
+                return -1;
+            break;
+        case 'o':
+            rpc_rate = strtod(optarg, NULL);
+            if (rpc_rate <= 0)
+                return -1;
+            break;
+        case 'r':
+            if (rx_idle_parse(optarg, &idle_conf) != 0)
+                return -1;
+            break;
+        case 'B':
+            if (tune_parse(optarg, &io_params) != 0)
+                return -1;
+            break;
+        case 'A':
+            tune_target = optarg;
+            break;
+        case 'E':
+            ecn_on = true;
+            break;
+        case 'K':
+            cksum_bench_only = true;
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (cksum_bench_only)
+        return 0;
+    if (argc - optind != 2)
+        return -1;
+    flow_num = (int) atoi(argv[optind]);
+    flow_sizes = argv[optind + 1];
+    if (flow_num < 1 || flow_num > MAX_FLOWS) {
+        printf("flow_num should be in [1, %d]\n", MAX_FLOWS);
+        return -1;
+    }
+    const int hdrs = sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + sizeof(struct tcp_ts_opt) +
+        (file_path != NULL ? sizeof(struct tcp_crc_opt) : 0); // on the FIN only, which may be full
+    if (mtu < RTE_ETHER_MIN_MTU || mtu > 9000 || packet_len < (1 << WIN_SHIFT) || packet_len + hdrs > mtu) {
+        printf("packet_len should be at least %d and with %d bytes of headers fit an mtu in [%d, 9000]\n",
+               1 << WIN_SHIFT, hdrs, RTE_ETHER_MIN_MTU);
+        return -1;
+    }
+    // a super-frame still has to fit the 16 bit IP total length
+    max_segs = RTE_MIN((uint32_t)TSO_MAX_SEGS, RTE_MIN(tso_bytes, (uint32_t)UINT16_MAX - hdrs) / packet_len);
+    if (max_segs < 2)
+        max_segs = 1;
+    if (file_path != NULL && rpc_req_bytes) {
+        printf("-f streams bulk data, it does not mix with -R\n");
+        return -1;
     }
+    if (rpc_req_bytes) {
+        rpc_segs = 1 + (rpc_req_bytes - 1) / packet_len;
+        if (rpc_rate > 0)
+            rpc_gap = RTE_MAX((uint64_t)(rte_get_tsc_hz() / rpc_rate), 1);
+    }
+    return 0;
+}
+
+/* rte_gso context for ports without TSO, headers come from the sending lcore's pool */
+static int
+init_gso(void)
+{
+    gso_ctx.direct_pool = lcore_pool[rte_lcore_id()];
+    gso_ctx.indirect_pool = rte_pktmbuf_pool_create("GSO_INDIRECT", GSO_INDIRECT_MBUFS, io_params.cache,
+                                                    0, 0, rte_socket_id());
+    if (gso_ctx.indirect_pool == NULL)
+        return -1;
+    gso_ctx.gso_types = RTE_ETH_TX_OFFLOAD_TCP_TSO;
+    gso_ctx.gso_size = TCP_HDR_OFF + sizeof(struct rte_tcp_hdr) + sizeof(struct tcp_ts_opt) + packet_len;
+    gso_ctx.flag = 0; // IP ids count up per segment
+    return 0;
 }
 
 /*
@@ -586,19 +2107,8 @@ lcore_main_rev(__rte_unused void *arg)
 int main(int argc, char *argv[])
 {
 
-	unsigned nb_ports;
 	uint16_t portid;
 
-    if (argc == 3) {
-        flow_num = (int) atoi(argv[1]);
-        flow_size =  (int) atoi(argv[2]);
-    } else {
-        printf( "usage: ./lab1-client <flow_num> <flow_size>\n");
-        return 1;
-    }
-
-    NUM_PING = 1 + (flow_size-1) / packet_len; // ceiling round instead of floor round 
-
 	/* Initializion the Environment Abstraction Layer (EAL). 8< */
 	int ret = rte_eal_init(argc, argv);
 	if (ret < 0)
@@ -608,57 +2118,115 @@ int main(int argc, char *argv[])
 	argc -= ret;
 	argv += ret;
 
-    nb_ports = rte_eth_dev_count_avail();
-	/* Allocates mempool to hold the mbufs. 8< */
-	mbuf_pool = rte_pktmbuf_pool_create("MBUF_POOL", NUM_MBUFS * nb_ports,
-										MBUF_CACHE_SIZE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
-	/* >8 End of allocating mempool to hold mbuf. */
+    /* application arguments follow the EAL ones */
+    argv[0] = argv[-ret];
+    if (parse_args(argc, argv) != 0) {
+        usage(argv[0]);
+        rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+    }
 
-	if (mbuf_pool == NULL)
-		rte_exit(EXIT_FAILURE, "Cannot create mbuf pool\n");
+    cksum_init();
+    if (cksum_bench_only) {
+        cksum_bench();
+        rte_eal_cleanup();
+        return 0;
+    }
+    // before any port is set up, the sweep reconfigures the one it runs on
+    if (tune_target != NULL && tune_run(tune_target, &io_params) != 0) {
+        rte_exit(EXIT_FAILURE, "Autotune failed\n");
+    }
+    datapath_select();
+
+	/* every port with a known peer up to PORT_NUM carries flows */
+	PKTIO_FOREACH_PORT(portid) {
+		if (nb_used_ports == PORT_NUM)
+			break;
+		if (rte_is_zero_ether_addr(&dst_eth[portid])) {
+			printf("port %u has no server MAC (-m), left unused\n", portid);
+			continue;
+		}
+		used_ports[nb_used_ports++] = portid;
+	}
+	if (nb_used_ports == 0)
+		rte_exit(EXIT_FAILURE, "No usable port\n");
+
+	/* per socket pools sized by rings, bursts and every flow's window in flight */
+	struct pool_sizing sz = { io_params.rx_ring, io_params.tx_ring, io_params.burst, io_params.cache,
+							  (uint64_t)flow_num * MAX_WIN_SIZE * packet_len };
+	if (pools_create(used_ports, nb_used_ports, &sz) != 0)
+		rte_exit(EXIT_FAILURE, "Cannot create mbuf pools\n");
+
+	if (file_path != NULL) {
+		if (file_open() != 0)
+			rte_exit(EXIT_FAILURE, "Cannot map %s\n", file_path);
+		file_dma_map();
+	}
 
 	/* Initializing all ports. 8< */
-	RTE_ETH_FOREACH_DEV(portid) 
-	if (portid == 1 && port_init(portid, mbuf_pool) != 0)
-		rte_exit(EXIT_FAILURE, "Cannot init port %" PRIu16 "\n",
-				 portid);
+	for (uint16_t p = 0; p < nb_used_ports; p++) {
+		portid = used_ports[p];
+		if (port_init(portid, pool_of_port(portid)) != 0)
+			rte_exit(EXIT_FAILURE, "Cannot init port %" PRIu16 "\n",
+					 portid);
+		init_parse_template(portid);
+		if (max_segs > 1 && !tso_hw[portid] && gso_ctx.indirect_pool == NULL && init_gso() != 0)
+			rte_exit(EXIT_FAILURE, "Cannot create GSO pool\n");
+	}
 	/* >8 End of initializing all ports. */
 
-    init_window(flow_num);
-    // printf("i am core %u\n", rte_lcore_id);
-    // standalone thread for rev
+    if (init_window(flow_num) != 0)
+        rte_exit(EXIT_FAILURE, "Cannot init windows\n");
+    if (stats_init(used_ports, nb_used_ports) != 0 ||
+        stats_register("flows", tel_flows, "Totals over every flow") != 0 ||
+        stats_register("flow", tel_flow, "Window of one flow. Parameters: int flow_id") != 0 ||
+        stats_register("latency", tel_latency, "RTT and RPC latency percentiles") != 0)
+        printf("telemetry commands not registered, is telemetry disabled?\n");
+    if (probe_init(stage_names, ST_NB) != 0)
+        rte_exit(EXIT_FAILURE, "Cannot init stage probes\n");
+    // standalone lcore for rev when the EAL gave us one
     unsigned int id = rte_get_next_lcore(-1, 1, 0);
-    // printf("target lcore is %u\n", id);
-    // printf("\nstart receving threads\n");
-    // rte_eal_remote_launch(lcore_main_rev, NULL, id);
-    // pthread_t tid;
-    // pthread_create(&tid, NULL, lcore_main_rev, NULL);
+    if (id < RTE_MAX_LCORE) {
+        printf("start receiving on lcore %u\n", id);
+        rx_lcore = id;
+        if (rte_eal_remote_launch(lcore_main_rev, NULL, id) != 0)
+            rte_exit(EXIT_FAILURE, "Cannot launch rx lcore\n");
+    }
+    // one more lcore samples NIC stats, the telemetry thread does when a reader asks otherwise
+    unsigned int stats_id = id < RTE_MAX_LCORE ? rte_get_next_lcore(id, 1, 0) : RTE_MAX_LCORE;
+    if (stats_id < RTE_MAX_LCORE && rte_eal_remote_launch(stats_lcore, NULL, stats_id) != 0)
+        stats_id = RTE_MAX_LCORE;
 
     // send thread in main lcore
     printf("start main sending threads\n");
 	lcore_main();
 	/* >8 End of called on single lcore. */
     printf("all sending done! waiting for receiving ack ...\n");
-    for (;;) {
-        for (int i=0; i<flow_num; i++) {
-            if (window_list[i].head < NUM_PING)
+    if (rx_lcore != RTE_MAX_LCORE)
+        rte_eal_wait_lcore(rx_lcore);
+    while (!all_acked())
+        receive_once();
+    // printf("all acked!");
+    if (rpc_req_bytes) {
+        // the last responses trail the last acks
+        uint64_t end = rte_rdtsc() + rte_get_tsc_hz() / 1000 * RPC_DRAIN_MS;
+        for (int i = 0; i < flow_num && rte_rdtsc() < end; ) {
+            if (rx_cold[i].rpc_done * rpc_segs >= tx_win[i].size)
+                i++;
+            else
                 receive_once();
-                continue;
         }
-        break;
     }
-    // rte_eal_wait_lcore(id);
-    // pthread_join(tid, NULL);
-    // printf("all acked!");
-    free(window_list);
+    stats_stop();
+    if (stats_id != RTE_MAX_LCORE)
+        rte_eal_wait_lcore(stats_id);
+    rtt_summary();
+    if (rpc_req_bytes)
+        rpc_summary();
+    probe_report();
+    pools_report(used_ports, nb_used_ports);
+    release_window();
 	/* clean up the EAL */
 	rte_eal_cleanup();
-    for (int i =0; i<20; i++) {
-        printf("%d\t", st[i]);
-    }
-    printf("\n");
-    for (int i =0; i<20; i++) {
-        printf("%d\t", rt[i]);
-    }
+	file_close();
 	return 0;
 }
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_cpuflags.h>
+#ifdef RTE_ARCH_X86
+#include <rte_vect.h>
+#endif
+
+#include "cksum.h"
+
+#define BENCH_ITERS 100000
+
+static uint64_t
+raw_scalar(const void *buf, size_t len, uint64_t sum)
+{
+	const uint8_t *p = buf;
+	uint32_t w;
+	uint16_t h = 0;
+
+	for (; len >= 4; len -= 4, p += 4) {
+		memcpy(&w, p, 4);
+		sum += w;
+	}
+	if (len >= 2) {
+		memcpy(&h, p, 2);
+		sum += h;
+		len -= 2;
+		p += 2;
+	}
+	// odd tail is the high byte of a zero padded word in network order
+	if (len) {
+		h = 0;
+		memcpy(&h, p, 1);
+		sum += h;
+	}
+	return sum;
+}
+
+#ifdef RTE_ARCH_X86
+// widen 32 bit words into 64 bit lanes so carries never get lost
+static uint64_t
+raw_sse2(const void *buf, size_t len, uint64_t sum)
+{
+	const uint8_t *p = buf;
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc0 = zero, acc1 = zero;
+	uint64_t lanes[2];
+
+	for (; len >= 16; len -= 16, p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+	}
+	_mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+	sum += cksum_fold(lanes[0]);
+	sum += cksum_fold(lanes[1]);
+	return raw_scalar(p, len, sum);
+}
+
+__attribute__((target("avx2")))
+static uint64_t
+raw_avx2(const void *buf, size_t len, uint64_t sum)
+{
+	const uint8_t *p = buf;
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc0 = zero, acc1 = zero;
+	uint64_t lanes[4];
+	int i;
+
+	for (; len >= 64; len -= 64, p += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+	}
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+	for (i = 0; i < 4; i++)
+		sum += cksum_fold(lanes[i]);
+	return raw_sse2(p, len, sum);
+}
+#endif
+
+uint64_t
+cksum_raw_mbuf(const struct rte_mbuf *m, uint32_t off, uint32_t len, uint64_t sum)
+{
+	uint32_t done = 0;
+
+	while (m != NULL && off >= m->data_len) {
+		off -= m->data_len;
+		m = m->next;
+	}
+	for (; m != NULL && len; m = m->next, off = 0) {
+		uint32_t n = RTE_MIN((uint32_t)m->data_len - off, len);
+		uint64_t part = cksum_raw(rte_pktmbuf_mtod_offset(m, const uint8_t *, off), n, 0);
+
+		// a segment starting at an odd offset lands in the other half of every word
+		if (done & 1) {
+			uint16_t f = cksum_fold(part);
+			part = (uint16_t)(f << 8 | f >> 8);
+		}
+		sum += part;
+		done += n;
+		len -= n;
+	}
+	return sum;
+}
+
+struct cksum_impl {
+	const char *name;
+	cksum_raw_t fn;
+	int usable;
+};
+
+static struct cksum_impl impls[] = {
+#ifdef RTE_ARCH_X86
+	{ "avx2", raw_avx2, 0 },
+	{ "sse2", raw_sse2, 0 },
+#endif
+	{ "scalar", raw_scalar, 1 },
+};
+
+cksum_raw_t cksum_raw = raw_scalar;
+static const char *impl_name = "scalar";
+
+const char *
+cksum_impl_name(void)
+{
+	return impl_name;
+}
+
+static void
+detect(void)
+{
+	size_t i;
+
+	for (i = 0; i < RTE_DIM(impls); i++) {
+#ifdef RTE_ARCH_X86
+		if (impls[i].fn == raw_avx2)
+			impls[i].usable = rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0;
+		else if (impls[i].fn == raw_sse2)
+			impls[i].usable = rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE2) > 0;
+#endif
+	}
+}
+
+unsigned int
+cksum_impl_count(void)
+{
+	return RTE_DIM(impls);
+}
+
+cksum_raw_t
+cksum_impl_get(unsigned int i, const char **name)
+{
+	detect();
+	*name = impls[i].name;
+	return impls[i].usable ? impls[i].fn : NULL;
+}
+
+void
+cksum_init(void)
+{
+	size_t i;
+
+	detect();
+	for (i = 0; i < RTE_DIM(impls); i++) {
+		if (impls[i].usable) {
+			cksum_raw = impls[i].fn;
+			impl_name = impls[i].name;
+			break;
+		}
+	}
+	printf("checksum: using %s implementation\n", impl_name);
+}
+
+void
+cksum_bench(void)
+{
+	static const size_t lens[] = { 20, 64, 512, 1500, 9000 };
+	static uint8_t buf[9000];
+	volatile uint64_t sink = 0;
+	uint64_t start, cycles;
+	size_t i, j;
+	int k;
+
+	memset(buf, 0xa5, sizeof(buf));
+	detect();
+	for (i = 0; i < RTE_DIM(impls); i++) {
+		if (!impls[i].usable)
+			continue;
+		for (j = 0; j < RTE_DIM(lens); j++) {
+			for (k = 0; k < BENCH_ITERS / 10; k++)
+				sink += impls[i].fn(buf, lens[j], 0);
+			start = rte_rdtsc_precise();
+			for (k = 0; k < BENCH_ITERS; k++)
+				sink += impls[i].fn(buf, lens[j], 0);
+			cycles = rte_rdtsc_precise() - start;
+			printf("cksum %-6s len %5zu: %8.2f cycles/pkt %6.3f cycles/byte\n",
+				impls[i].name, lens[j], (double)cycles / BENCH_ITERS,
+				(double)cycles / BENCH_ITERS / lens[j]);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 Internet checksum (RFC 1071) shared by client and server.
+ *
+ * Sums are kept in memory byte order, so a finished checksum is stored into
+ * the header as is and network order constants (pseudo header protocol and
+ * length) are added through rte_cpu_to_be_16(). The bulk summing routine is
+ * picked once by cksum_init() from the CPU flags: AVX2, SSE2 or scalar.
+ */
+
+#ifndef LAB1_CKSUM_H
+#define LAB1_CKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <rte_byteorder.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+
+/* raw 64 bit one's complement accumulation of len bytes at buf */
+typedef uint64_t (*cksum_raw_t)(const void *buf, size_t len, uint64_t sum);
+extern cksum_raw_t cksum_raw;
+
+/* raw accumulation of len bytes of an mbuf chain, starting off bytes into it */
+uint64_t cksum_raw_mbuf(const struct rte_mbuf *m, uint32_t off, uint32_t len, uint64_t sum);
+
+/* pick the fastest implementation the CPU supports, make check holds the test vectors */
+void cksum_init(void);
+/* built in implementation i of cksum_impl_count(), NULL if the CPU lacks it */
+unsigned int cksum_impl_count(void);
+cksum_raw_t cksum_impl_get(unsigned int i, const char **name);
+/* print cycles per byte of every implementation for common lengths */
+void cksum_bench(void);
+/* implementation cksum_init() picked, for the startup banner */
+const char *cksum_impl_name(void);
+
+static inline uint16_t
+cksum_fold(uint64_t sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)sum;
+}
+
+/* checksum of a payload, ready to store */
+static inline uint16_t
+cksum_buf(const void *buf, size_t len)
+{
+	return (uint16_t)~cksum_fold(cksum_raw(buf, len, 0));
+}
+
+/* IPv4 header checksum, hdr_checksum has to be zero */
+static inline uint16_t
+cksum_ipv4_hdr(const struct rte_ipv4_hdr *ip)
+{
+	return cksum_buf(ip, (ip->version_ihl & 0x0f) * 4);
+}
+
+/* TCP/UDP checksum over pseudo header and l4_len bytes at l4, the l4 checksum field has to be zero */
+static inline uint16_t
+cksum_ipv4_l4(const struct rte_ipv4_hdr *ip, const void *l4, size_t l4_len)
+{
+	uint64_t sum = (uint64_t)ip->src_addr + ip->dst_addr +
+		rte_cpu_to_be_16((uint16_t)ip->next_proto_id) + rte_cpu_to_be_16((uint16_t)l4_len);
+	return (uint16_t)~cksum_fold(cksum_raw(l4, l4_len, sum));
+}
+
+/* same for an l4 header and payload spread over a chained mbuf */
+static inline uint16_t
+cksum_ipv4_l4_mbuf(const struct rte_ipv4_hdr *ip, const struct rte_mbuf *m, uint32_t l4_off, uint32_t l4_len)
+{
+	uint64_t sum = (uint64_t)ip->src_addr + ip->dst_addr +
+		rte_cpu_to_be_16((uint16_t)ip->next_proto_id) + rte_cpu_to_be_16((uint16_t)l4_len);
+	return (uint16_t)~cksum_fold(cksum_raw_mbuf(m, l4_off, l4_len, sum));
+}
+
+/* RFC 1624 incremental update for a 16 bit field changing from old_val to new_val */
+static inline uint16_t
+cksum_update16(uint16_t cksum, uint16_t old_val, uint16_t new_val)
+{
+	uint64_t sum = (uint16_t)~cksum + (uint16_t)~old_val + new_val;
+	return (uint16_t)~cksum_fold(sum);
+}
+
+static inline uint16_t
+cksum_update32(uint16_t cksum, uint32_t old_val, uint32_t new_val)
+{
+	uint64_t sum = (uint16_t)~cksum + (uint64_t)(uint32_t)~old_val + new_val;
+	return (uint16_t)~cksum_fold(sum);
+}
+
+#endif /* LAB1_CKSUM_H */
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 specialized datapaths. A hot function is written once as an
+ * __rte_always_inline template whose run-constant inputs are parameters,
+ * each binary instantiates it for the configurations below and picks one
+ * at startup, so divisions, multiplications and branches on those inputs
+ * fold away. Segment size 0 is the generic copy reading the runtime value.
+ *   64    minimum frames, packet rate bound
+ *   1000  the lab default (-l)
+ *   1448  MSS at MTU 1500 with the timestamp option
+ *   8948  MSS at MTU 9000 with the timestamp option
+ * The server also specializes on its receive window, every power of two
+ * its -n takes, so window offsets and masks are constants too.
+ */
+
+#ifndef LAB1_DATAPATH_H
+#define LAB1_DATAPATH_H
+
+/* X(seg_size, arg) once per specialized segment size */
+#define DATAPATH_SEG_SIZES(X, arg) X(64, arg) X(1000, arg) X(1448, arg) X(8948, arg)
+/* X(win, arg) once per receive window, smallest first */
+#define DATAPATH_WIN_SIZES(X, arg) X(8, arg) X(16, arg) X(32, arg) X(64, arg)
+
+#endif /* LAB1_DATAPATH_H */
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flowq.h"
+
+size_t
+flowq_fifo_memsize(uint32_t nb_ids, uint32_t nb_lists)
+{
+	return sizeof(uint32_t) * ((size_t)nb_ids + 2 * nb_lists);
+}
+
+void
+flowq_fifo_init(struct flowq_fifo *q, void *mem, uint32_t nb_ids, uint32_t nb_lists)
+{
+	q->nb_lists = nb_lists;
+	q->busy = 0;
+	q->next = mem;
+	q->head = q->next + nb_ids;
+	q->tail = q->head + nb_lists;
+}
+
+size_t
+flowq_heap_memsize(uint32_t nb_ids)
+{
+	return sizeof(struct flowq_ent) * nb_ids;
+}
+
+void
+flowq_heap_init(struct flowq_heap *h, void *mem, uint32_t nb_ids)
+{
+	(void)nb_ids;
+	h->len = 0;
+	h->order = 0;
+	h->ent = mem;
+}
+
+static inline int
+ent_less(const struct flowq_ent *a, const struct flowq_ent *b)
+{
+	if (a->key != b->key)
+		return a->key < b->key;
+	return (int32_t)(a->order - b->order) < 0;
+}
+
+void
+flowq_heap_push(struct flowq_heap *h, uint32_t id, uint64_t key)
+{
+	struct flowq_ent e = { .key = key, .order = h->order++, .id = id };
+	uint32_t i = h->len++;
+
+	while (i > 0) {
+		uint32_t up = (i - 1) / 2;
+
+		if (!ent_less(&e, &h->ent[up]))
+			break;
+		h->ent[i] = h->ent[up];
+		i = up;
+	}
+	h->ent[i] = e;
+}
+
+uint32_t
+flowq_heap_pop(struct flowq_heap *h)
+{
+	struct flowq_ent last;
+	uint32_t id, i = 0;
+
+	if (h->len == 0)
+		return FLOWQ_NONE;
+	id = h->ent[0].id;
+	last = h->ent[--h->len];
+	for (;;) {
+		uint32_t c = 2 * i + 1;
+
+		if (c >= h->len)
+			break;
+		if (c + 1 < h->len && ent_less(&h->ent[c + 1], &h->ent[c]))
+			c++;
+		if (!ent_less(&h->ent[c], &last))
+			break;
+		h->ent[i] = h->ent[c];
+		i = c;
+	}
+	h->ent[i] = last;
+	return id;
+}
+
+size_t
+flowq_wheel_memsize(uint32_t nb_ids, uint32_t nb_slots)
+{
+	return sizeof(uint64_t) * nb_ids + sizeof(uint32_t) * (nb_slots + 3 * (size_t)nb_ids);
+}
+
+void
+flowq_wheel_init(struct flowq_wheel *w, void *mem, uint32_t nb_ids, uint32_t nb_slots,
+		 uint64_t tick, uint64_t now)
+{
+	w->tick = tick;
+	w->cur = now / tick;
+	w->mask = nb_slots - 1;
+	w->expire = mem;
+	w->slot = (uint32_t *)(w->expire + nb_ids);
+	w->next = w->slot + nb_slots;
+	w->prev = w->next + nb_ids;
+	w->where = w->prev + nb_ids;
+	memset(w->slot, 0xff, sizeof(uint32_t) * nb_slots);
+	memset(w->where, 0xff, sizeof(uint32_t) * nb_ids);
+}
+
+void
+flowq_wheel_cancel(struct flowq_wheel *w, uint32_t id)
+{
+	uint32_t s = w->where[id];
+
+	if (s == FLOWQ_NONE)
+		return;
+	if (w->prev[id] == FLOWQ_NONE)
+		w->slot[s] = w->next[id];
+	else
+		w->next[w->prev[id]] = w->next[id];
+	if (w->next[id] != FLOWQ_NONE)
+		w->prev[w->next[id]] = w->prev[id];
+	w->where[id] = FLOWQ_NONE;
+}
+
+void
+flowq_wheel_arm(struct flowq_wheel *w, uint32_t id, uint64_t expire)
+{
+	uint64_t t = expire / w->tick;
+	uint32_t s;
+
+	flowq_wheel_cancel(w, id);
+	if (t < w->cur)
+		t = w->cur;
+	s = t & w->mask;
+	w->expire[id] = expire;
+	w->where[id] = s;
+	w->prev[id] = FLOWQ_NONE;
+	w->next[id] = w->slot[s];
+	if (w->slot[s] != FLOWQ_NONE)
+		w->prev[w->slot[s]] = id;
+	w->slot[s] = id;
+}
+
+uint32_t
+flowq_wheel_expire(struct flowq_wheel *w, uint64_t now, uint32_t *ids, uint32_t n)
+{
+	uint64_t end = now / w->tick;
+	uint64_t t = w->cur;
+	uint32_t nb = 0;
+
+	if (end < t)
+		return 0;
+	/* after a long pause one turn visits every slot */
+	if (end - t > w->mask)
+		t = end - w->mask;
+	for (; t <= end; t++) {
+		uint32_t id = w->slot[t & w->mask];
+
+		while (id != FLOWQ_NONE) {
+			uint32_t next = w->next[id];
+
+			if (w->expire[id] <= now) {
+				if (nb == n) {
+					w->cur = t;
+					return nb;
+				}
+				flowq_wheel_cancel(w, id);
+				ids[nb++] = id;
+			}
+			id = next;
+		}
+	}
+	// the current slot can still take timers due later in this tick
+	w->cur = end;
+	return nb;
+}
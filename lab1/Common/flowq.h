@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 flow queues for the client scheduler, so handing out the next flow
+ * or firing its timers never walks every flow:
+ *  - fifo: FIFO lists of ids sharing one link array, an id is on at most
+ *    one list of a set. Round robin uses one list, priority classes one
+ *    each, popped lowest class first.
+ *  - heap: binary min-heap of ids on a 64 bit key, equal keys in insertion
+ *    order. Shortest remaining first and WFQ.
+ *  - wheel: hashed timer wheel of fixed length ticks, one timer per id,
+ *    arming, re-arming and cancelling are O(1).
+ * None of them removes an id from the middle: the scheduler pops an id,
+ * checks it can still send and drops it if not. Each structure lives in one
+ * block of *_memsize() bytes from the caller. Single threaded, no EAL,
+ * ../Test drives them directly.
+ */
+
+#ifndef LAB1_FLOWQ_H
+#define LAB1_FLOWQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define FLOWQ_NONE UINT32_MAX
+#define FLOWQ_MAX_LISTS 64
+
+struct flowq_fifo {
+	uint32_t nb_lists;
+	uint64_t busy; // bit per non empty list
+	uint32_t *next; // [nb_ids] link to the next id on the same list
+	uint32_t *head; // [nb_lists]
+	uint32_t *tail; // [nb_lists]
+};
+
+size_t flowq_fifo_memsize(uint32_t nb_ids, uint32_t nb_lists);
+void flowq_fifo_init(struct flowq_fifo *q, void *mem, uint32_t nb_ids, uint32_t nb_lists);
+
+static inline void
+flowq_fifo_push(struct flowq_fifo *q, uint32_t list, uint32_t id)
+{
+	q->next[id] = FLOWQ_NONE;
+	if (q->busy & (1ULL << list))
+		q->next[q->tail[list]] = id;
+	else
+		q->head[list] = id;
+	q->tail[list] = id;
+	q->busy |= 1ULL << list;
+}
+
+static inline uint32_t
+flowq_fifo_pop(struct flowq_fifo *q, uint32_t list)
+{
+	uint32_t id;
+
+	if (!(q->busy & (1ULL << list)))
+		return FLOWQ_NONE;
+	id = q->head[list];
+	q->head[list] = q->next[id];
+	if (q->head[list] == FLOWQ_NONE)
+		q->busy &= ~(1ULL << list);
+	return id;
+}
+
+/* head of the lowest numbered non empty list */
+static inline uint32_t
+flowq_fifo_pop_first(struct flowq_fifo *q)
+{
+	return q->busy ? flowq_fifo_pop(q, __builtin_ctzll(q->busy)) : FLOWQ_NONE;
+}
+
+/*
+ * Empty a list and return its old head, walk it with flowq_fifo_next().
+ * Ids may be pushed again during the walk, read the next one first.
+ */
+static inline uint32_t
+flowq_fifo_take(struct flowq_fifo *q, uint32_t list)
+{
+	if (!(q->busy & (1ULL << list)))
+		return FLOWQ_NONE;
+	q->busy &= ~(1ULL << list);
+	return q->head[list];
+}
+
+static inline uint32_t
+flowq_fifo_next(const struct flowq_fifo *q, uint32_t id)
+{
+	return q->next[id];
+}
+
+struct flowq_ent {
+	uint64_t key;
+	uint32_t order; // insertion count, breaks ties first in first out
+	uint32_t id;
+};
+
+struct flowq_heap {
+	uint32_t len;
+	uint32_t order;
+	struct flowq_ent *ent; // [nb_ids], an id is in at most once
+};
+
+size_t flowq_heap_memsize(uint32_t nb_ids);
+void flowq_heap_init(struct flowq_heap *h, void *mem, uint32_t nb_ids);
+void flowq_heap_push(struct flowq_heap *h, uint32_t id, uint64_t key);
+/* id of the smallest key, FLOWQ_NONE when empty */
+uint32_t flowq_heap_pop(struct flowq_heap *h);
+
+static inline bool
+flowq_heap_empty(const struct flowq_heap *h)
+{
+	return h->len == 0;
+}
+
+/*
+ * Timers hash into nb_slots (a power of two) slots by expiry tick. One
+ * that is more than a turn of the wheel out stays in its slot until the
+ * turn it is due, flowq_wheel_expire() checks the exact time.
+ */
+struct flowq_wheel {
+	uint64_t tick; // time units per slot, TSC cycles in the client
+	uint64_t cur; // first tick not yet fully expired
+	uint32_t mask; // nb_slots - 1
+	uint32_t *slot; // [nb_slots] first timer of each slot
+	uint32_t *next; // [nb_ids]
+	uint32_t *prev; // [nb_ids]
+	uint32_t *where; // [nb_ids] slot of an armed timer, FLOWQ_NONE if idle
+	uint64_t *expire; // [nb_ids]
+};
+
+size_t flowq_wheel_memsize(uint32_t nb_ids, uint32_t nb_slots);
+void flowq_wheel_init(struct flowq_wheel *w, void *mem, uint32_t nb_ids, uint32_t nb_slots,
+		      uint64_t tick, uint64_t now);
+/* (re)arm timer id for time expire, one in the past fires on the next expire */
+void flowq_wheel_arm(struct flowq_wheel *w, uint32_t id, uint64_t expire);
+void flowq_wheel_cancel(struct flowq_wheel *w, uint32_t id);
+/* up to n timers due by now into ids[] and idle again, call again while it fills ids[] */
+uint32_t flowq_wheel_expire(struct flowq_wheel *w, uint64_t now, uint32_t *ids, uint32_t n);
+
+static inline bool
+flowq_wheel_armed(const struct flowq_wheel *w, uint32_t id)
+{
+	return w->where[id] != FLOWQ_NONE;
+}
+
+#endif /* LAB1_FLOWQ_H */
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_ether.h>
+#include <rte_flow.h>
+
+#include "flowrule.h"
+
+#define PRIO_STEER 0
+#define PRIO_DROP 1 // below every steering rule
+
+static int
+create(uint16_t port, uint32_t prio, const struct rte_flow_item *pattern,
+       const struct rte_flow_action *actions, struct rte_flow_error *err)
+{
+	const struct rte_flow_attr attr = { .priority = prio, .ingress = 1 };
+
+	if (rte_flow_validate(port, &attr, pattern, actions, err) != 0)
+		return -1;
+	return rte_flow_create(port, &attr, pattern, actions, err) != NULL ? 0 : -1;
+}
+
+/* exact adds IHL and the TCP port ranges, coarse stops at the IPv4 protocol */
+static int
+steer(uint16_t port, const struct rte_ether_addr *mac, uint8_t proto,
+      const struct flowrule_range *r, bool exact, struct rte_flow_error *err)
+{
+	struct rte_flow_item_eth eth_spec, eth_mask;
+	struct rte_flow_item_ipv4 ip_spec, ip_mask;
+	struct rte_flow_item_tcp tcp_spec, tcp_last, tcp_mask;
+	struct rte_flow_action_queue queue = { .index = r->queue };
+
+	memset(&eth_spec, 0, sizeof(eth_spec));
+	memset(&eth_mask, 0, sizeof(eth_mask));
+	rte_ether_addr_copy(mac, &eth_spec.dst);
+	memset(&eth_mask.dst, 0xff, sizeof(eth_mask.dst));
+	eth_spec.type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+	eth_mask.type = 0xffff;
+
+	memset(&ip_spec, 0, sizeof(ip_spec));
+	memset(&ip_mask, 0, sizeof(ip_mask));
+	ip_spec.hdr.next_proto_id = proto;
+	ip_mask.hdr.next_proto_id = 0xff;
+	if (exact) {
+		ip_spec.hdr.version_ihl = 0x45;
+		ip_mask.hdr.version_ihl = 0xff;
+	}
+
+	memset(&tcp_spec, 0, sizeof(tcp_spec));
+	memset(&tcp_last, 0, sizeof(tcp_last));
+	memset(&tcp_mask, 0, sizeof(tcp_mask));
+	tcp_spec.hdr.src_port = rte_cpu_to_be_16(r->src_lo);
+	tcp_last.hdr.src_port = rte_cpu_to_be_16(r->src_hi);
+	tcp_spec.hdr.dst_port = rte_cpu_to_be_16(r->dst_lo);
+	tcp_last.hdr.dst_port = rte_cpu_to_be_16(r->dst_hi);
+	tcp_mask.hdr.src_port = tcp_mask.hdr.dst_port = 0xffff;
+
+	struct rte_flow_item pattern[] = {
+		{ .type = RTE_FLOW_ITEM_TYPE_ETH, .spec = &eth_spec, .mask = &eth_mask },
+		{ .type = RTE_FLOW_ITEM_TYPE_IPV4, .spec = &ip_spec, .mask = &ip_mask },
+		{ .type = RTE_FLOW_ITEM_TYPE_TCP, .spec = &tcp_spec, .last = &tcp_last, .mask = &tcp_mask },
+		{ .type = RTE_FLOW_ITEM_TYPE_END },
+	};
+	const struct rte_flow_action actions[] = {
+		{ .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue },
+		{ .type = RTE_FLOW_ACTION_TYPE_END },
+	};
+
+	if (!exact)
+		pattern[2].type = RTE_FLOW_ITEM_TYPE_END;
+	return create(port, PRIO_STEER, pattern, actions, err);
+}
+
+static int
+drop_rest(uint16_t port, struct rte_flow_error *err)
+{
+	const struct rte_flow_item pattern[] = {
+		{ .type = RTE_FLOW_ITEM_TYPE_ETH },
+		{ .type = RTE_FLOW_ITEM_TYPE_END },
+	};
+	const struct rte_flow_action actions[] = {
+		{ .type = RTE_FLOW_ACTION_TYPE_DROP },
+		{ .type = RTE_FLOW_ACTION_TYPE_END },
+	};
+
+	return create(port, PRIO_DROP, pattern, actions, err);
+}
+
+enum flowrule_level
+flowrule_install(uint16_t port, const struct rte_ether_addr *mac, uint8_t proto,
+		 const struct flowrule_range *ranges, unsigned int nb)
+{
+	static const char *const level_names[] = { "none", "MAC/protocol", "MAC/protocol/ports" };
+	struct rte_flow_error err;
+	enum flowrule_level level = FLOWRULE_EXACT;
+	unsigned int i = 0;
+
+	memset(&err, 0, sizeof(err));
+	// port ranges only exist for TCP, the item would not match anything else
+	if (proto == IPPROTO_TCP)
+		for (i = 0; i < nb; i++)
+			if (steer(port, mac, proto, &ranges[i], true, &err) != 0)
+				break;
+	if (proto != IPPROTO_TCP || i < nb) {
+		rte_flow_flush(port, &err);
+		// without ports a frame cannot pick its range, so every range has to share the queue
+		level = FLOWRULE_COARSE;
+		for (i = 1; i < nb && ranges[i].queue == ranges[0].queue; i++)
+			;
+		if (nb == 0 || i < nb || steer(port, mac, proto, &ranges[0], false, &err) != 0)
+			goto none;
+	}
+	if (drop_rest(port, &err) != 0)
+		goto none;
+	printf("port %u: rte_flow steers by %s, the rest is dropped in the NIC\n", port, level_names[level]);
+	return level;
+
+none:
+	printf("port %u: no rte_flow filtering (%s), done in software\n",
+	       port, err.message != NULL ? err.message : "unsupported");
+	rte_flow_flush(port, &err);
+	return FLOWRULE_NONE;
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 filtering in the NIC with rte_flow. Frames for the port's MAC of the
+ * lab protocol whose TCP ports fall in a flow range are steered to the
+ * range's queue, a lower priority rule drops everything else, so junk never
+ * reaches an lcore and the port can leave promiscuous mode. PMDs that take
+ * no port ranges get a coarser MAC/protocol rule; without rte_flow at all
+ * the application keeps filtering in software.
+ */
+
+#ifndef LAB1_FLOWRULE_H
+#define LAB1_FLOWRULE_H
+
+#include <stdint.h>
+#include <rte_ether.h>
+
+enum flowrule_level {
+	FLOWRULE_NONE,   // nothing installed, every frame has to be checked in software
+	FLOWRULE_COARSE, // MAC, IPv4 and protocol matched in hardware, the rest in software
+	FLOWRULE_EXACT,  // MAC, IPv4 with IHL 5, protocol and port ranges all in hardware
+};
+
+struct flowrule_range {
+	uint16_t src_lo, src_hi; // TCP source ports, host order, inclusive
+	uint16_t dst_lo, dst_hi;
+	uint16_t queue;
+};
+
+/* after rte_eth_dev_start, a port falling back to FLOWRULE_NONE has no rule left */
+enum flowrule_level flowrule_install(uint16_t port, const struct rte_ether_addr *mac, uint8_t proto,
+				     const struct flowrule_range *ranges, unsigned int nb);
+
+#endif /* LAB1_FLOWRULE_H */
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 log-linear histogram: every power of two is split into HIST_SUB
+ * linear buckets, so any recorded value is off by less than 1/HIST_SUB
+ * while the whole 64 bit range fits in a few KB. Single writer, no locks.
+ */
+
+#ifndef LAB1_HIST_H
+#define LAB1_HIST_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[HIST_BUCKETS];
+};
+
+static inline void
+hist_reset(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+static inline unsigned int
+hist_index(uint64_t v)
+{
+	if (v < HIST_SUB)
+		return (unsigned int)v;
+	unsigned int msb = 63 - __builtin_clzll(v);
+	unsigned int shift = msb - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + (unsigned int)((v >> shift) & (HIST_SUB - 1));
+}
+
+/* smallest value that lands in bucket i */
+static inline uint64_t
+hist_value(unsigned int i)
+{
+	if (i < HIST_SUB)
+		return i;
+	unsigned int shift = i / HIST_SUB - 1;
+	return (uint64_t)(HIST_SUB + i % HIST_SUB) << shift;
+}
+
+static inline void
+hist_add(struct hist *h, uint64_t v)
+{
+	h->bucket[hist_index(v)]++;
+	h->count++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+}
+
+/* value at quantile q in [0, 1], the lower edge of its bucket */
+static inline uint64_t
+hist_quantile(const struct hist *h, double q)
+{
+	uint64_t rank = (uint64_t)(q * h->count), seen = 0;
+
+	if (h->count == 0)
+		return 0;
+	if (rank >= h->count)
+		return h->max;
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen > rank)
+			return hist_value(i);
+	}
+	return h->max;
+}
+
+#endif /* LAB1_HIST_H */
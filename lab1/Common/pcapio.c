@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+#include "pcapio.h"
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_SNAPLEN 65535
+
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t major;
+	uint16_t minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_rec_hdr {
+	uint32_t sec;
+	uint32_t frac; // us or ns by the magic
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static uint32_t
+host32(uint32_t v, bool swap)
+{
+	return swap ? rte_bswap32(v) : v;
+}
+
+int
+pcapio_open(struct pcapio_reader *r, const char *path)
+{
+	struct pcap_file_hdr fh;
+	uint32_t magic;
+
+	r->f = fopen(path, "rb");
+	if (r->f == NULL) {
+		printf("Cannot open %s\n", path);
+		return -1;
+	}
+	if (fread(&fh, sizeof(fh), 1, r->f) != 1)
+		goto bad;
+	r->swap = fh.magic == rte_bswap32(PCAP_MAGIC_US) || fh.magic == rte_bswap32(PCAP_MAGIC_NS);
+	magic = host32(fh.magic, r->swap);
+	if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS)
+		goto bad;
+	r->ns = magic == PCAP_MAGIC_NS;
+	if (host32(fh.linktype, r->swap) != PCAP_LINKTYPE_ETHERNET) {
+		printf("%s: only Ethernet captures are supported\n", path);
+		goto fail;
+	}
+	return 0;
+
+bad:
+	printf("%s: not a readable pcap file\n", path);
+fail:
+	pcapio_close(r);
+	return -1;
+}
+
+int
+pcapio_next(struct pcapio_reader *r, struct pcapio_rec *rec)
+{
+	struct pcap_rec_hdr rh;
+	size_t n = fread(&rh, 1, sizeof(rh), r->f);
+
+	if (n == 0 && feof(r->f))
+		return 1;
+	if (n != sizeof(rh))
+		return -1;
+	rec->caplen = host32(rh.caplen, r->swap);
+	rec->len = host32(rh.len, r->swap);
+	rec->ts_ns = host32(rh.sec, r->swap) * 1000000000ULL +
+		host32(rh.frac, r->swap) * (r->ns ? 1 : 1000);
+	// an mbuf holds the frame in one segment
+	return rec->caplen > UINT16_MAX - RTE_PKTMBUF_HEADROOM ? -1 : 0;
+}
+
+int
+pcapio_skip(struct pcapio_reader *r, const struct pcapio_rec *rec)
+{
+	return fseek(r->f, rec->caplen, SEEK_CUR) == 0 ? 0 : -1;
+}
+
+int
+pcapio_rewind(struct pcapio_reader *r)
+{
+	return fseek(r->f, sizeof(struct pcap_file_hdr), SEEK_SET) == 0 ? 0 : -1;
+}
+
+void
+pcapio_close(struct pcapio_reader *r)
+{
+	if (r->f != NULL)
+		fclose(r->f);
+	r->f = NULL;
+}
+
+int
+pcapio_load(const char *path, int socket, struct pcapio_capture *cap)
+{
+	struct pcapio_reader r;
+	struct pcapio_rec rec;
+	uint32_t max_len = 0, nb = 0, cut = 0;
+	int ret;
+
+	memset(cap, 0, sizeof(*cap));
+	if (pcapio_open(&r, path) < 0)
+		return -1;
+
+	/* first pass sizes the pool: frame count and the longest one */
+	while ((ret = pcapio_next(&r, &rec)) == 0) {
+		if (pcapio_skip(&r, &rec) < 0)
+			goto bad;
+		max_len = RTE_MAX(max_len, rec.caplen);
+		nb++;
+	}
+	if (ret < 0)
+		goto bad;
+	if (nb == 0) {
+		printf("%s: no frames\n", path);
+		goto fail;
+	}
+
+	char name[RTE_MEMPOOL_NAMESIZE];
+	snprintf(name, sizeof(name), "PCAP_POOL_%d", socket);
+	cap->pool = rte_pktmbuf_pool_create(name, nb, 0, 0, RTE_PKTMBUF_HEADROOM + max_len, socket);
+	cap->pkts = rte_malloc_socket("pcap_pkts", sizeof(*cap->pkts) * nb, 0, socket);
+	cap->ts_ns = rte_malloc_socket("pcap_ts", sizeof(*cap->ts_ns) * nb, 0, socket);
+	if (cap->pool == NULL || cap->pkts == NULL || cap->ts_ns == NULL) {
+		printf("%s: cannot allocate %u frames of up to %u bytes\n", path, nb, max_len);
+		goto fail;
+	}
+
+	if (pcapio_rewind(&r) < 0)
+		goto bad;
+	for (cap->nb = 0; cap->nb < nb; cap->nb++) {
+		struct rte_mbuf *m;
+		char *p;
+
+		if (pcapio_next(&r, &rec) != 0)
+			goto bad;
+		m = rte_pktmbuf_alloc(cap->pool);
+		p = m ? rte_pktmbuf_append(m, rec.caplen) : NULL;
+		if (p == NULL || fread(p, 1, rec.caplen, r.f) != rec.caplen) {
+			rte_pktmbuf_free(m);
+			goto bad;
+		}
+		cut += rec.caplen < rec.len;
+		cap->pkts[cap->nb] = m;
+		cap->ts_ns[cap->nb] = rec.ts_ns;
+	}
+	pcapio_close(&r);
+	printf("%s: %u frames, longest %u bytes", path, nb, max_len);
+	if (cut)
+		printf(", %u cut short by the snaplen", cut);
+	printf("\n");
+	return 0;
+
+bad:
+	printf("%s: not a readable pcap file\n", path);
+fail:
+	pcapio_close(&r);
+	while (cap->nb)
+		rte_pktmbuf_free(cap->pkts[--cap->nb]);
+	rte_free(cap->pkts);
+	rte_free(cap->ts_ns);
+	rte_mempool_free(cap->pool);
+	memset(cap, 0, sizeof(*cap));
+	return -1;
+}
+
+FILE *
+pcapio_create(const char *path)
+{
+	struct pcap_file_hdr fh = {
+		.magic = PCAP_MAGIC_NS,
+		.major = 2,
+		.minor = 4,
+		.snaplen = PCAP_SNAPLEN,
+		.linktype = PCAP_LINKTYPE_ETHERNET,
+	};
+	FILE *f = fopen(path, "wb");
+
+	if (f != NULL && fwrite(&fh, sizeof(fh), 1, f) != 1) {
+		fclose(f);
+		f = NULL;
+	}
+	return f;
+}
+
+int
+pcapio_write(FILE *f, const struct rte_mbuf *m, uint64_t ts_ns)
+{
+	struct pcap_rec_hdr rh = {
+		.sec = ts_ns / 1000000000,
+		.frac = ts_ns % 1000000000,
+		.caplen = RTE_MIN(m->pkt_len, (uint32_t)PCAP_SNAPLEN),
+		.len = m->pkt_len,
+	};
+	uint32_t left = rh.caplen;
+
+	if (fwrite(&rh, sizeof(rh), 1, f) != 1)
+		return -1;
+	for (; m != NULL && left; m = m->next) {
+		uint32_t n = RTE_MIN(left, (uint32_t)m->data_len);
+
+		if (fwrite(rte_pktmbuf_mtod(m, const void *), 1, n, f) != n)
+			return -1;
+		left -= n;
+	}
+	return 0;
+}
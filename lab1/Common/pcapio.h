@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 classic pcap files without libpcap: pcapio_load() reads a whole
+ * Ethernet capture, microsecond or nanosecond, either byte order, into
+ * mbufs of a pool sized for it with the record reader below, which needs
+ * no EAL; pcapio_create()/pcapio_write() produce a
+ * nanosecond capture in host order. Names stay clear of libpcap's, which
+ * the net_pcap PMD links in static builds.
+ */
+
+#ifndef LAB1_PCAPIO_H
+#define LAB1_PCAPIO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <rte_mbuf.h>
+
+struct pcapio_capture {
+	struct rte_mempool *pool;
+	struct rte_mbuf **pkts;
+	uint64_t *ts_ns; // capture time of pkts[i]
+	uint32_t nb;
+};
+
+struct pcapio_reader {
+	FILE *f;
+	bool swap; // written on a host of the other byte order
+	bool ns;
+};
+
+struct pcapio_rec {
+	uint32_t caplen; // bytes that follow in the file
+	uint32_t len; // on the wire
+	uint64_t ts_ns;
+};
+
+/* 0 once the file header is that of an Ethernet capture, closed on failure */
+int pcapio_open(struct pcapio_reader *r, const char *path);
+/* next record header, its caplen bytes follow: 0, 1 at the end, -1 if broken */
+int pcapio_next(struct pcapio_reader *r, struct pcapio_rec *rec);
+int pcapio_skip(struct pcapio_reader *r, const struct pcapio_rec *rec);
+/* back to the first record */
+int pcapio_rewind(struct pcapio_reader *r);
+void pcapio_close(struct pcapio_reader *r);
+
+/* 0 on success, frames cut short by the snaplen are loaded as captured */
+int pcapio_load(const char *path, int socket, struct pcapio_capture *cap);
+FILE *pcapio_create(const char *path);
+int pcapio_write(FILE *f, const struct rte_mbuf *m, uint64_t ts_ns);
+
+#endif /* LAB1_PCAPIO_H */
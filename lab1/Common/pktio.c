@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#define _GNU_SOURCE // sendmmsg
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <rte_common.h>
+
+#include "pktio.h"
+
+#define AFP_BLOCK_SIZE (1 << 18)
+#define AFP_BLOCK_NR 64
+#define AFP_FRAME_SIZE 2048 // only sizes the ring for V3, frames are packed into blocks
+#define AFP_BLOCK_TOV_MS 1 // a partly filled block is handed over after this long
+#define AFP_TX_BATCH 64
+#define AFP_TX_MAX_SEGS 8 // a 9000 byte frame spans 5 default mbufs
+
+struct afp_port {
+	int fd;
+	uint8_t *ring;
+	size_t ring_len;
+	unsigned int block; // block being read
+	struct tpacket3_hdr *frame; // next frame of that block, NULL before it is opened
+	uint32_t left; // frames left in it
+	struct rte_mempool *mp;
+	struct rte_eth_stats st;
+	char ifname[IF_NAMESIZE];
+};
+
+enum pktio_backend pktio_backend = PKTIO_DPDK;
+static struct afp_port afp[PKTIO_AFP_MAX_PORTS];
+static uint16_t nb_afp;
+
+int
+pktio_parse(const char *arg)
+{
+	if (!strcmp(arg, "dpdk")) {
+		pktio_backend = PKTIO_DPDK;
+		return 0;
+	}
+	if (strncmp(arg, "afpacket:", 9) != 0)
+		return -1;
+	pktio_backend = PKTIO_AFPACKET;
+	nb_afp = 0;
+	for (const char *p = arg + 9; *p; ) {
+		size_t n = strcspn(p, ",");
+		if (n == 0 || n >= IF_NAMESIZE || nb_afp == PKTIO_AFP_MAX_PORTS)
+			return -1;
+		memcpy(afp[nb_afp].ifname, p, n);
+		afp[nb_afp].ifname[n] = '\0';
+		afp[nb_afp++].fd = -1;
+		p += n;
+		if (*p == ',')
+			p++;
+	}
+	return nb_afp ? 0 : -1;
+}
+
+uint16_t
+pktio_next_port(uint16_t port)
+{
+	if (pktio_backend == PKTIO_DPDK)
+		return (uint16_t)rte_eth_find_next_owned_by(port, RTE_ETH_DEV_NO_OWNER);
+	return port < nb_afp ? port : RTE_MAX_ETHPORTS;
+}
+
+static int
+afp_ifreq(int fd, unsigned long req, const char *ifname, struct ifreq *ifr)
+{
+	memset(ifr, 0, sizeof(*ifr));
+	strncpy(ifr->ifr_name, ifname, IF_NAMESIZE - 1);
+	return ioctl(fd, req, ifr);
+}
+
+int
+pktio_port_init(uint16_t port, struct rte_mempool *mp, uint16_t mtu, struct rte_ether_addr *mac)
+{
+	struct afp_port *a = &afp[port];
+	int ver = TPACKET_V3, one = 1;
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+	int err;
+
+	if (port >= nb_afp)
+		return -EINVAL;
+	a->mp = mp;
+	a->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (a->fd < 0)
+		goto fail;
+	if (setsockopt(a->fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) != 0)
+		goto fail;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = AFP_BLOCK_SIZE;
+	req.tp_block_nr = AFP_BLOCK_NR;
+	req.tp_frame_size = AFP_FRAME_SIZE;
+	req.tp_frame_nr = AFP_BLOCK_SIZE / AFP_FRAME_SIZE * AFP_BLOCK_NR;
+	req.tp_retire_blk_tov = AFP_BLOCK_TOV_MS;
+	if (setsockopt(a->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+		goto fail;
+	a->ring_len = (size_t)AFP_BLOCK_SIZE * AFP_BLOCK_NR;
+	a->ring = mmap(NULL, a->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, a->fd, 0);
+	if (a->ring == MAP_FAILED) {
+		a->ring = NULL;
+		goto fail;
+	}
+
+	// our own frames would come back through the ring otherwise
+#ifdef PACKET_IGNORE_OUTGOING
+	setsockopt(a->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+	setsockopt(a->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = if_nametoindex(a->ifname);
+	if (sll.sll_ifindex == 0 || bind(a->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0)
+		goto fail;
+
+	// promiscuous like the ethdev ports
+	struct packet_mreq mr = { .mr_ifindex = sll.sll_ifindex, .mr_type = PACKET_MR_PROMISC };
+	setsockopt(a->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr));
+
+	if (afp_ifreq(a->fd, SIOCGIFHWADDR, a->ifname, &ifr) != 0)
+		goto fail;
+	memcpy(mac->addr_bytes, ifr.ifr_hwaddr.sa_data, RTE_ETHER_ADDR_LEN);
+	if (afp_ifreq(a->fd, SIOCGIFMTU, a->ifname, &ifr) != 0)
+		goto fail;
+	if (ifr.ifr_mtu < mtu) {
+		ifr.ifr_mtu = mtu;
+		if (ioctl(a->fd, SIOCSIFMTU, &ifr) != 0) {
+			err = errno;
+			printf("%s: cannot raise the mtu to %u\n", a->ifname, mtu);
+			errno = err;
+			goto fail;
+		}
+	}
+	printf("port %u: %s over AF_PACKET TPACKET_V3\n", port, a->ifname);
+	return 0;
+fail:
+	err = errno; // the cleanup below may clobber it
+	printf("port %u: cannot open %s: %s\n", port, a->ifname, strerror(err));
+	if (a->ring != NULL)
+		munmap(a->ring, a->ring_len);
+	if (a->fd >= 0)
+		close(a->fd);
+	a->ring = NULL;
+	a->fd = -1;
+	return -err;
+}
+
+/* copy a frame out of the ring, chained when it is larger than one mbuf */
+static struct rte_mbuf *
+afp_copy(struct rte_mempool *mp, const uint8_t *data, uint32_t len)
+{
+	struct rte_mbuf *head = rte_pktmbuf_alloc(mp), *last = head;
+
+	if (head == NULL)
+		return NULL;
+	while (len) {
+		if (rte_pktmbuf_tailroom(last) == 0) {
+			struct rte_mbuf *m = rte_pktmbuf_alloc(mp);
+			if (m == NULL || rte_pktmbuf_chain(head, m) != 0) {
+				rte_pktmbuf_free(m);
+				rte_pktmbuf_free(head);
+				return NULL;
+			}
+			last = m;
+		}
+		uint16_t n = RTE_MIN((uint32_t)rte_pktmbuf_tailroom(last), len);
+		memcpy(rte_pktmbuf_append(head, n), data, n);
+		data += n;
+		len -= n;
+	}
+	return head;
+}
+
+uint16_t
+afp_rx_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb)
+{
+	struct afp_port *a = &afp[port];
+	uint16_t n = 0;
+
+	while (n < nb) {
+		struct tpacket_block_desc *bd =
+			(struct tpacket_block_desc *)(a->ring + (size_t)a->block * AFP_BLOCK_SIZE);
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			break;
+		if (a->frame == NULL) {
+			a->frame = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+			a->left = bd->hdr.bh1.num_pkts;
+		}
+		for (; a->left && n < nb; a->left--) {
+			struct rte_mbuf *m = afp_copy(a->mp, (uint8_t *)a->frame + a->frame->tp_mac,
+										  a->frame->tp_snaplen);
+			if (m == NULL) {
+				a->st.rx_nombuf++;
+				return n; // the frame stays for the next burst
+			}
+			a->st.ipackets++;
+			a->st.ibytes += m->pkt_len;
+			pkts[n++] = m;
+			a->frame = (struct tpacket3_hdr *)((uint8_t *)a->frame + a->frame->tp_next_offset);
+		}
+		if (a->left == 0) { // block done, back to the kernel
+			__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+			a->block = (a->block + 1) % AFP_BLOCK_NR;
+			a->frame = NULL;
+		}
+	}
+	return n;
+}
+
+/* one sendmmsg per burst, mbuf segments go out as an iovec and are freed once the kernel copied them */
+uint16_t
+afp_tx_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb)
+{
+	struct afp_port *a = &afp[port];
+	struct mmsghdr msg[AFP_TX_BATCH];
+	struct iovec iov[AFP_TX_BATCH][AFP_TX_MAX_SEGS];
+	uint16_t n;
+
+	nb = RTE_MIN(nb, (uint16_t)AFP_TX_BATCH);
+	for (n = 0; n < nb; n++) {
+		struct rte_mbuf *m = pkts[n];
+		unsigned int k = 0;
+		if (m->nb_segs > AFP_TX_MAX_SEGS)
+			break;
+		for (struct rte_mbuf *s = m; s != NULL; s = s->next, k++) {
+			iov[n][k].iov_base = rte_pktmbuf_mtod(s, void *);
+			iov[n][k].iov_len = s->data_len;
+		}
+		memset(&msg[n], 0, sizeof(msg[n]));
+		msg[n].msg_hdr.msg_iov = iov[n];
+		msg[n].msg_hdr.msg_iovlen = k;
+	}
+	if (n == 0)
+		return 0;
+	int sent = sendmmsg(a->fd, msg, n, MSG_DONTWAIT);
+	if (sent <= 0) {
+		a->st.oerrors++;
+		return 0;
+	}
+	for (int i = 0; i < sent; i++) {
+		a->st.opackets++;
+		a->st.obytes += pkts[i]->pkt_len;
+		rte_pktmbuf_free(pkts[i]);
+	}
+	return sent;
+}
+
+int
+pktio_stats_get(uint16_t port, struct rte_eth_stats *st)
+{
+	if (pktio_backend == PKTIO_DPDK)
+		return rte_eth_stats_get(port, st);
+	if (port >= nb_afp || afp[port].fd < 0)
+		return -ENODEV;
+
+	// the kernel resets its counters on every read
+	struct tpacket_stats_v3 ks;
+	socklen_t len = sizeof(ks);
+	if (getsockopt(afp[port].fd, SOL_PACKET, PACKET_STATISTICS, &ks, &len) == 0)
+		__atomic_fetch_add(&afp[port].st.imissed, ks.tp_drops, __ATOMIC_RELAXED);
+	*st = afp[port].st;
+	return 0;
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 packet I/O backends. The transport only sees port ids and bursts of
+ * mbufs, buffers still come from pool_alloc() and go back with
+ * rte_pktmbuf_free() whatever moves them:
+ *   dpdk      ethdev ports, which includes the net_af_xdp and net_af_packet
+ *             vdevs (--vdev net_af_xdp0,iface=veth0)
+ *   afpacket  kernel interfaces through a TPACKET_V3 rx ring and sendmmsg,
+ *             no DPDK NIC needed (EAL with --no-pci), port N is the Nth name
+ */
+
+#ifndef LAB1_PKTIO_H
+#define LAB1_PKTIO_H
+
+#include <stdint.h>
+#include <rte_branch_prediction.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+
+#define PKTIO_AFP_MAX_PORTS 8
+
+enum pktio_backend {
+	PKTIO_DPDK,
+	PKTIO_AFPACKET,
+};
+
+extern enum pktio_backend pktio_backend;
+
+/* "dpdk" or "afpacket:IFACE[,IFACE...]" */
+int pktio_parse(const char *arg);
+/* next usable port from port on, RTE_MAX_ETHPORTS when there is none */
+uint16_t pktio_next_port(uint16_t port);
+/* open a non ethdev port, rx frames are copied into mbufs of mp */
+int pktio_port_init(uint16_t port, struct rte_mempool *mp, uint16_t mtu, struct rte_ether_addr *mac);
+/* rte_eth_stats_get for every backend */
+int pktio_stats_get(uint16_t port, struct rte_eth_stats *st);
+
+uint16_t afp_rx_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb);
+uint16_t afp_tx_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb);
+
+#define PKTIO_FOREACH_PORT(p) \
+	for (p = pktio_next_port(0); p < RTE_MAX_ETHPORTS; p = pktio_next_port(p + 1))
+
+static inline uint16_t
+pktio_rx_burst(uint16_t port, uint16_t queue, struct rte_mbuf **pkts, uint16_t nb)
+{
+	if (likely(pktio_backend == PKTIO_DPDK))
+		return rte_eth_rx_burst(port, queue, pkts, nb);
+	return afp_rx_burst(port, pkts, nb);
+}
+
+/* like rte_eth_tx_burst the backend owns what it returns as sent */
+static inline uint16_t
+pktio_tx_burst(uint16_t port, uint16_t queue, struct rte_mbuf **pkts, uint16_t nb)
+{
+	if (likely(pktio_backend == PKTIO_DPDK))
+		return rte_eth_tx_burst(port, queue, pkts, nb);
+	return afp_tx_burst(port, pkts, nb);
+}
+
+#endif /* LAB1_PKTIO_H */
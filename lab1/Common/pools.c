@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_ethdev.h>
+#include <rte_mempool.h>
+#include <rte_mbuf.h>
+
+#include "pools.h"
+#include "pktio.h"
+
+struct rte_mempool *lcore_pool[RTE_MAX_LCORE];
+struct pool_lcore_stats pool_stats[RTE_MAX_LCORE];
+static struct rte_mempool *socket_pool[RTE_MAX_NUMA_NODES];
+
+static int
+port_socket(uint16_t port)
+{
+	int s = rte_eth_dev_socket_id(port);
+
+	// virtual devices report no socket, keep them next to the main lcore
+	if (s < 0 || s >= RTE_MAX_NUMA_NODES)
+		s = rte_lcore_to_socket_id(rte_get_main_lcore());
+	return s;
+}
+
+int
+pools_create(const uint16_t *ports, unsigned int nb_ports, const struct pool_sizing *sz)
+{
+	unsigned int nports[RTE_MAX_NUMA_NODES] = { 0 };
+	unsigned int nlcores[RTE_MAX_NUMA_NODES] = { 0 };
+	uint64_t inflight = (sz->inflight_bytes + RTE_MBUF_DEFAULT_DATAROOM - 1) / RTE_MBUF_DEFAULT_DATAROOM;
+	char name[RTE_MEMPOOL_NAMESIZE];
+	unsigned int i, lcore;
+	int s;
+
+	for (i = 0; i < nb_ports; i++)
+		nports[port_socket(ports[i])]++;
+	RTE_LCORE_FOREACH(lcore)
+		nlcores[rte_lcore_to_socket_id(lcore)]++;
+
+	for (s = 0; s < RTE_MAX_NUMA_NODES; s++) {
+		if (!nports[s] && !nlcores[s])
+			continue;
+		/* full rings of local ports, a burst in hand and a warm cache per lcore, plus in flight data */
+		uint64_t n = (uint64_t)nports[s] * (sz->rx_ring + sz->tx_ring) +
+			nlcores[s] * (sz->burst + sz->cache) + (nlcores[s] ? inflight : 0);
+		n = RTE_MIN(n, (uint64_t)POOL_MAX_MBUFS);
+		n = rte_align32pow2((uint32_t)n + 1) - 1; // ring backed pools waste the rest
+		snprintf(name, sizeof(name), "MBUF_POOL_%d", s);
+		socket_pool[s] = rte_pktmbuf_pool_create(name, n, sz->cache, 0,
+							 RTE_MBUF_DEFAULT_BUF_SIZE, s);
+		if (socket_pool[s] == NULL) {
+			printf("Cannot create %s with %" PRIu64 " mbufs\n", name, n);
+			return -1;
+		}
+		printf("%s: %" PRIu64 " mbufs for %u ports, %u lcores\n", name, n, nports[s], nlcores[s]);
+	}
+	RTE_LCORE_FOREACH(lcore)
+		lcore_pool[lcore] = socket_pool[rte_lcore_to_socket_id(lcore)];
+	return 0;
+}
+
+struct rte_mempool *
+pool_of_port(uint16_t port)
+{
+	return socket_pool[port_socket(port)];
+}
+
+void
+pools_report(const uint16_t *ports, unsigned int nb_ports)
+{
+	struct rte_eth_stats st;
+	uint64_t fail = 0;
+	unsigned int i;
+	int s;
+
+	for (i = 0; i < RTE_MAX_LCORE; i++)
+		fail += pool_stats[i].alloc_fail;
+	for (s = 0; s < RTE_MAX_NUMA_NODES; s++)
+		if (socket_pool[s] != NULL)
+			printf("%s: %u of %u mbufs in use\n", socket_pool[s]->name,
+			       rte_mempool_in_use_count(socket_pool[s]), socket_pool[s]->size);
+	printf("mbuf allocation failures: %" PRIu64 "\n", fail);
+	for (i = 0; i < nb_ports; i++)
+		if (pktio_stats_get(ports[i], &st) == 0)
+			printf("port %u rx_nombuf: %" PRIu64 "\n", ports[i], st.rx_nombuf);
+}
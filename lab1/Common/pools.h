@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 NUMA aware mbuf pools: one pool per socket that hosts a used port or
+ * an enabled lcore. RX queues fill from their port's socket and every lcore
+ * allocates from its own, so no mbuf crosses the interconnect.
+ */
+
+#ifndef LAB1_POOLS_H
+#define LAB1_POOLS_H
+
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_branch_prediction.h>
+
+#define POOL_MAX_MBUFS ((1 << 17) - 1)
+
+struct pool_sizing {
+	unsigned int rx_ring;    // descriptors per rx queue
+	unsigned int tx_ring;    // descriptors per tx queue
+	unsigned int burst;
+	unsigned int cache;      // per lcore mempool cache
+	uint64_t inflight_bytes; // payload an lcore may hold unacked or queued
+};
+
+struct pool_lcore_stats {
+	uint64_t alloc_fail;
+} __rte_cache_aligned;
+
+extern struct rte_mempool *lcore_pool[RTE_MAX_LCORE];
+extern struct pool_lcore_stats pool_stats[RTE_MAX_LCORE];
+
+/* create the per socket pools covering ports[] and every enabled lcore, 0 on success */
+int pools_create(const uint16_t *ports, unsigned int nb_ports, const struct pool_sizing *sz);
+struct rte_mempool *pool_of_port(uint16_t port);
+/* per socket occupancy, allocation failures and rx_nombuf of ports[] */
+void pools_report(const uint16_t *ports, unsigned int nb_ports);
+
+/* allocate from the calling lcore's socket, exhaustion is counted not fatal */
+static inline struct rte_mbuf *
+pool_alloc(void)
+{
+	unsigned int lcore = rte_lcore_id();
+	struct rte_mbuf *m = rte_pktmbuf_alloc(lcore_pool[lcore]);
+
+	if (unlikely(m == NULL)) // single writer, telemetry loads it
+		__atomic_store_n(&pool_stats[lcore].alloc_fail, pool_stats[lcore].alloc_fail + 1,
+				 __ATOMIC_RELAXED);
+	return m;
+}
+
+#endif /* LAB1_POOLS_H */
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include "probe.h"
+
+#ifdef LAB1_PROBES
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <rte_malloc.h>
+
+#include "stats.h"
+
+#define PROBE_CALIBRATE_MARKS 100000
+
+struct probe_lcore *probe_lcores[RTE_MAX_LCORE];
+static const char *const *stage_names;
+static unsigned int nb_stage_names;
+static uint64_t overhead; // cycles a mark adds to the stage it closes
+
+/* median delta of back to back marks, what a stage with no work would show */
+static void
+calibrate(struct probe_lcore *p)
+{
+	probe_begin();
+	for (int i = 0; i < PROBE_CALIBRATE_MARKS; i++)
+		probe_mark(0, 0);
+	overhead = hist_quantile(&p->stage[0].cycles, 0.5);
+	hist_reset(&p->stage[0].cycles);
+	p->stage[0].pkts = 0;
+}
+
+/* cycles of a stage with the probe overhead taken out */
+static uint64_t
+net_cycles(const struct probe_stage *s)
+{
+	uint64_t ovh = s->cycles.count * overhead;
+	return s->cycles.sum > ovh ? s->cycles.sum - ovh : 0;
+}
+
+static int
+tel_probes(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+	char name[64];
+	unsigned int lcore;
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_uint(d, "overhead_cycles", overhead);
+	RTE_LCORE_FOREACH(lcore) {
+		struct probe_lcore *p = probe_lcores[lcore];
+		if (p == NULL)
+			continue;
+		for (unsigned int k = 0; k < nb_stage_names; k++) {
+			const struct probe_stage *s = &p->stage[k];
+			if (s->cycles.count == 0)
+				continue;
+			snprintf(name, sizeof(name), "lcore%u_%s_cycles", lcore, stage_names[k]);
+			rte_tel_data_add_dict_uint(d, name, net_cycles(s));
+			snprintf(name, sizeof(name), "lcore%u_%s_pkts", lcore, stage_names[k]);
+			rte_tel_data_add_dict_uint(d, name, s->pkts);
+			snprintf(name, sizeof(name), "lcore%u_%s_p99", lcore, stage_names[k]);
+			rte_tel_data_add_dict_uint(d, name, hist_quantile(&s->cycles, 0.99));
+		}
+	}
+	return 0;
+}
+
+int
+probe_init(const char *const *names, unsigned int nb_stages)
+{
+	unsigned int lcore;
+
+	if (nb_stages > PROBE_MAX_STAGES)
+		return -1;
+	stage_names = names;
+	nb_stage_names = nb_stages;
+	RTE_LCORE_FOREACH(lcore) {
+		probe_lcores[lcore] = rte_zmalloc_socket("probe", sizeof(struct probe_lcore),
+												 RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore));
+		if (probe_lcores[lcore] == NULL)
+			return -1;
+	}
+	calibrate(probe_lcores[rte_lcore_id()]);
+	printf("stage probes on, %" PRIu64 " cycles per mark\n", overhead);
+	stats_register("probes", tel_probes, "Net cycles, packets and p99 per lcore and stage");
+	return 0;
+}
+
+void
+probe_report(void)
+{
+	unsigned int lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		struct probe_lcore *p = probe_lcores[lcore];
+		uint64_t total = 0;
+
+		if (p == NULL)
+			continue;
+		for (unsigned int k = 0; k < nb_stage_names; k++)
+			total += net_cycles(&p->stage[k]);
+		if (total == 0)
+			continue;
+		printf("lcore %u stages, %" PRIu64 " cycles per mark taken out:\n", lcore, overhead);
+		printf("  %-8s %12s %12s %8s %8s %8s %10s %9s %6s\n",
+			   "stage", "marks", "pkts", "mean", "p50", "p99", "max", "cyc/pkt", "share");
+		for (unsigned int k = 0; k < nb_stage_names; k++) {
+			const struct probe_stage *s = &p->stage[k];
+			if (s->cycles.count == 0)
+				continue;
+			uint64_t net = net_cycles(s);
+			printf("  %-8s %12" PRIu64 " %12" PRIu64 " %8.0f %8" PRIu64 " %8" PRIu64 " %10" PRIu64 " %9.1f %5.1f%%\n",
+				   stage_names[k], s->cycles.count, s->pkts, (double)net / s->cycles.count,
+				   hist_quantile(&s->cycles, 0.5), hist_quantile(&s->cycles, 0.99), s->cycles.max,
+				   s->pkts ? (double)net / s->pkts : 0.0, 100.0 * net / total);
+		}
+	}
+}
+
+#endif /* LAB1_PROBES */
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 stage probes: a loop calls PROBE_BEGIN() once and PROBE_MARK(stage, n)
+ * at the end of every stage, each mark files the TSC delta since the
+ * previous one into a per-lcore histogram together with the n packets the
+ * stage handled. Only built with -DLAB1_PROBES (make PROBES=1), otherwise
+ * the macros are empty and the hot loops are untouched. probe_init()
+ * measures what a mark itself costs, the report takes it out again.
+ */
+
+#ifndef LAB1_PROBE_H
+#define LAB1_PROBE_H
+
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+
+#include "hist.h"
+
+#define PROBE_MAX_STAGES 16
+
+#ifdef LAB1_PROBES
+
+struct probe_stage {
+	struct hist cycles; // per mark
+	uint64_t pkts;
+};
+
+struct probe_lcore {
+	uint64_t last; // TSC of the previous mark
+	struct probe_stage stage[PROBE_MAX_STAGES];
+} __rte_cache_aligned;
+
+extern struct probe_lcore *probe_lcores[RTE_MAX_LCORE];
+
+/* stage names index the stages, calibrate on the calling lcore, 0 on success */
+int probe_init(const char *const *names, unsigned int nb_stages);
+/* per lcore and stage cycles, percentiles and cycles per packet */
+void probe_report(void);
+
+static inline void
+probe_begin(void)
+{
+	unsigned int id = rte_lcore_id();
+
+	if (id < RTE_MAX_LCORE && probe_lcores[id] != NULL)
+		probe_lcores[id]->last = rte_rdtsc();
+}
+
+static inline void
+probe_mark(unsigned int stage, uint32_t pkts)
+{
+	unsigned int id = rte_lcore_id();
+	struct probe_lcore *p;
+
+	if (id >= RTE_MAX_LCORE || (p = probe_lcores[id]) == NULL)
+		return;
+	uint64_t now = rte_rdtsc();
+	hist_add(&p->stage[stage].cycles, now - p->last);
+	p->stage[stage].pkts += pkts;
+	p->last = now;
+}
+
+#define PROBE_BEGIN() probe_begin()
+#define PROBE_MARK(stage, pkts) probe_mark((stage), (pkts))
+
+#else
+
+static inline int probe_init(const char *const *names __rte_unused, unsigned int nb_stages __rte_unused) { return 0; }
+static inline void probe_report(void) {}
+
+#define PROBE_BEGIN() do { } while (0)
+#define PROBE_MARK(stage, pkts) do { } while (0)
+
+#endif /* LAB1_PROBES */
+
+#endif /* LAB1_PROBE_H */
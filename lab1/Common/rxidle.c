@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_pause.h>
+#include <rte_ethdev.h>
+#include <rte_interrupts.h>
+
+#include "rxidle.h"
+
+#define PAUSE_BATCH 16
+
+int
+rx_idle_parse(const char *arg, struct rx_idle_conf *conf)
+{
+	long v[3] = { conf->busy_polls, conf->pause_us, conf->sleep_ms };
+	char *end;
+	int i;
+
+	for (i = 0; i < 3 && *arg; i++) {
+		if (*arg != ',') {
+			v[i] = strtol(arg, &end, 10);
+			if (end == arg || v[i] < 0)
+				return -1;
+			arg = end;
+		}
+		if (*arg == ',')
+			arg++;
+		else if (*arg)
+			return -1;
+	}
+	if (*arg)
+		return -1;
+	conf->busy_polls = v[0];
+	conf->pause_us = v[1];
+	conf->sleep_ms = v[2];
+	return 0;
+}
+
+void
+rx_idle_port_conf(const struct rx_idle_conf *conf, struct rte_eth_conf *port_conf)
+{
+	port_conf->intr_conf.rxq = conf->sleep_ms > 0;
+}
+
+void
+rx_idle_init(struct rx_idle *idle, const struct rx_idle_conf *conf)
+{
+	memset(idle, 0, sizeof(*idle));
+	idle->conf = conf;
+	idle->pause_cycles = rte_get_tsc_hz() / 1000000 * conf->pause_us;
+	idle->intr = conf->sleep_ms > 0;
+}
+
+int
+rx_idle_add(struct rx_idle *idle, uint16_t port, uint16_t queue, bool intr_configured)
+{
+	if (idle->nb_queues == RX_IDLE_MAX_QUEUES)
+		return -1;
+	idle->port[idle->nb_queues] = port;
+	idle->queue[idle->nb_queues] = queue;
+	idle->nb_queues++;
+	if (!idle->intr)
+		return 0;
+	// one queue without interrupts could starve while we sleep, so none sleeps
+	if (!intr_configured ||
+	    rte_eth_dev_rx_intr_ctl_q(port, queue, RTE_EPOLL_PER_THREAD,
+				      RTE_INTR_EVENT_ADD, NULL) != 0) {
+		printf("port %u queue %u: no rx interrupt, idling by pause only\n", port, queue);
+		idle->intr = false;
+	}
+	return 0;
+}
+
+static void
+sleep_on_intr(struct rx_idle *idle)
+{
+	struct rte_epoll_event ev;
+	uint16_t i, armed;
+	bool pending = false;
+
+	for (armed = 0; armed < idle->nb_queues; armed++)
+		if (rte_eth_dev_rx_intr_enable(idle->port[armed], idle->queue[armed]) != 0)
+			break;
+	/* packets that landed before the enable do not raise an interrupt, the timeout bounds that */
+	for (i = 0; i < armed && !pending; i++)
+		pending = rte_eth_rx_queue_count(idle->port[i], idle->queue[i]) > 0;
+	if (armed == idle->nb_queues && !pending) {
+		idle->sleeps++;
+		if (rte_epoll_wait(RTE_EPOLL_PER_THREAD, &ev, 1, idle->conf->sleep_ms) <= 0)
+			idle->timeouts++;
+	}
+	for (i = 0; i < armed; i++)
+		rte_eth_dev_rx_intr_disable(idle->port[i], idle->queue[i]);
+}
+
+void
+rx_idle_backoff(struct rx_idle *idle)
+{
+	uint64_t now = rte_rdtsc();
+	int i;
+
+	if (idle->empty == idle->conf->busy_polls + 1)
+		idle->idle_start = now;
+	if (now - idle->idle_start < idle->pause_cycles || !idle->intr || !idle->nb_queues) {
+		for (i = 0; i < PAUSE_BATCH; i++)
+			rte_pause();
+		return;
+	}
+	sleep_on_intr(idle);
+	// wake into busy polling, the next packets are likely close behind
+	idle->empty = 0;
+}
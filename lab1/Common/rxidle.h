@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 adaptive RX idling: busy poll while traffic flows, spin on rte_pause
+ * for a TSC bounded while once the queue runs dry, then arm the queue
+ * interrupt and block in epoll until a packet (or the timeout) wakes us.
+ */
+
+#ifndef LAB1_RXIDLE_H
+#define LAB1_RXIDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct rte_eth_conf;
+
+struct rx_idle_conf {
+	unsigned int busy_polls; // empty polls before backing off
+	unsigned int pause_us;   // rte_pause spinning before sleeping
+	int sleep_ms;            // epoll timeout, 0 never sleeps
+};
+
+#define RX_IDLE_CONF_DEFAULT { 256, 200, 10 }
+#define RX_IDLE_MAX_QUEUES 16
+
+struct rx_idle {
+	const struct rx_idle_conf *conf;
+	uint16_t nb_queues;
+	uint16_t port[RX_IDLE_MAX_QUEUES];
+	uint16_t queue[RX_IDLE_MAX_QUEUES];
+	bool intr;              // every queue registered with this lcore's epoll
+	unsigned int empty;     // consecutive empty polls
+	uint64_t idle_start;    // tsc when pausing began
+	uint64_t pause_cycles;
+	uint64_t sleeps;
+	uint64_t timeouts;      // sleeps no interrupt cut short
+};
+
+/* parse "busy_polls,pause_us,sleep_ms", missing fields keep their value */
+int rx_idle_parse(const char *arg, struct rx_idle_conf *conf);
+/* ask for rx queue interrupts when sleeping is on, before rte_eth_dev_configure */
+void rx_idle_port_conf(const struct rx_idle_conf *conf, struct rte_eth_conf *port_conf);
+void rx_idle_init(struct rx_idle *idle, const struct rx_idle_conf *conf);
+/* has to run on the polling lcore, its epoll instance gets the queue */
+int rx_idle_add(struct rx_idle *idle, uint16_t port, uint16_t queue, bool intr_configured);
+/* slow path of rx_idle_update */
+void rx_idle_backoff(struct rx_idle *idle);
+
+/* call after every sweep over the queues with the packets it got */
+static inline void
+rx_idle_update(struct rx_idle *idle, uint16_t nb_rx)
+{
+	if (nb_rx) {
+		idle->empty = 0;
+		return;
+	}
+	if (++idle->empty > idle->conf->busy_polls)
+		rx_idle_backoff(idle);
+}
+
+#endif /* LAB1_RXIDLE_H */
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 server receive window: which segments of a flow arrived past its
+ * cumulative ack, and the in-order coalescing of a parsed burst. No EAL or
+ * port state in here, the tests in ../Test drive it directly.
+ *
+ * A window covers win segments from head on (at most RXWIN_MAX), bit i of
+ * acked is segment head + i. In RPC mode psh marks the last segment of each
+ * request and shifts along with acked.
+ */
+
+#ifndef LAB1_RXWIN_H
+#define LAB1_RXWIN_H
+
+#include <stdint.h>
+#include <rte_common.h>
+#include <rte_mbuf.h>
+#include <rte_tcp.h>
+
+#define RXWIN_MAX 64
+
+/* a slot is free until its first flow, closed flows keep head to answer retransmissions */
+enum win_state { WIN_FREE, WIN_OPEN, WIN_CLOSED };
+
+struct rx_window {
+	uint64_t acked; // 10111010001100 [tail-99, head-0]
+	uint64_t psh; // segments that end an RPC request, shifts along with acked
+	int head;
+	int fin_seq; // seq of the FIN segment, -1 until it arrives
+	uint32_t ts_recent; // latest tsval from the client, echoed in every ack, kept from the last segment once closed
+	uint8_t state; // enum win_state
+} __rte_aligned(32);
+
+/* compact per-burst view of the received segments */
+struct seg_desc {
+	int flow_id; // -1 if the frame is not a segment of ours
+	uint32_t seq;
+	uint16_t nseg; // segments from seq on, more than one once GRO merged them
+	uint8_t flags;
+	uint32_t tsval;
+	uint16_t ect; // segments of the run sent ECN capable
+	uint16_t ce;  // segments of the run a switch marked
+};
+
+/* the low n bits, n up to 64 */
+static inline uint64_t
+rxwin_bits(unsigned int n)
+{
+	return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+/* mark nseg consecutive segments from seq, returns how many fell outside the window */
+static inline uint16_t
+rxwin_mark(struct rx_window *w, uint32_t seq, uint16_t nseg, unsigned int win)
+{
+	int lo = seq - w->head;
+	int hi = RTE_MIN(lo + nseg, (int)win);
+
+	if (lo < 0)
+		lo = 0;
+	if (hi <= lo)
+		return nseg;
+	w->acked |= rxwin_bits(hi - lo) << lo;
+	return nseg - (hi - lo);
+}
+
+/* seq is the last segment of a request, answered once the ack passes it */
+static inline void
+rxwin_psh(struct rx_window *w, uint32_t seq, unsigned int win)
+{
+	int off = seq - w->head;
+
+	if (off >= 0 && off < (int)win)
+		w->psh |= 1ULL << off;
+}
+
+/*
+ * Advance head past the segments in order, the trailing ones of acked, and
+ * return the last of them. The seqs of the requests they complete, the psh
+ * bits among them, go to done[] which has room for win.
+ */
+static inline uint32_t
+rxwin_advance(struct rx_window *w, uint32_t *done, uint16_t *nb_done, unsigned int win)
+{
+	unsigned int n = ~w->acked ? (unsigned int)__builtin_ctzll(~w->acked) : 64;
+	uint64_t psh;
+
+	n = RTE_MIN(n, win);
+	psh = w->psh & rxwin_bits(n);
+	*nb_done = 0;
+	while (psh) {
+		done[(*nb_done)++] = w->head + __builtin_ctzll(psh);
+		psh &= psh - 1;
+	}
+	w->acked = n < 64 ? w->acked >> n : 0;
+	w->psh = n < 64 ? w->psh >> n : 0;
+	__atomic_store_n(&w->head, w->head + n, __ATOMIC_RELAXED); // telemetry loads it
+	return w->head - 1;
+}
+
+/*
+ * In-order receive coalescing over a parsed burst: a segment that directly
+ * follows the previous one of the same flow joins its run, so a TSO/GSO
+ * train costs one window update and one ack. The run keeps the first
+ * frame's headers for the ack, the latest tsval and the FIN of its last
+ * segment, it never grows past a FIN or a PSH. bufs[] and desc[] are
+ * compacted in place and the new count returned; the mbufs folded into a
+ * run go to merged[] for the caller to free in one go.
+ * rte_gro would not merge these, the timestamp option differs between
+ * segments.
+ */
+static inline uint16_t
+gro_burst(struct rte_mbuf **bufs, struct seg_desc *desc, uint16_t nb,
+	  struct rte_mbuf **merged, uint16_t *nb_merged)
+{
+	uint16_t i, out = 0;
+
+	*nb_merged = 0;
+	for (i = 0; i < nb; i++) {
+		struct seg_desc *run = out ? &desc[out - 1] : NULL;
+
+		if (run != NULL && desc[i].flow_id >= 0 && desc[i].flow_id == run->flow_id &&
+		    desc[i].seq == run->seq + run->nseg &&
+		    !(run->flags & (RTE_TCP_FIN_FLAG | RTE_TCP_PSH_FLAG))) {
+			run->nseg++;
+			run->flags |= desc[i].flags;
+			run->ect += desc[i].ect;
+			run->ce += desc[i].ce;
+			if (desc[i].tsval != 0)
+				run->tsval = desc[i].tsval;
+			merged[(*nb_merged)++] = bufs[i];
+			continue;
+		}
+		bufs[out] = bufs[i];
+		desc[out++] = desc[i];
+	}
+	return out;
+}
+
+#endif /* LAB1_RXWIN_H */
@@ -0,0 +1,220 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_spinlock.h>
+#include <rte_ethdev.h>
+#include <rte_mempool.h>
+
+#include "stats.h"
+#include "pools.h"
+#include "pktio.h"
+
+struct port_sample {
+	uint64_t tsc;
+	struct rte_eth_stats st;
+	double rx_pps, tx_pps; // rates over the last interval
+	double rx_bps, tx_bps;
+	int nb_xstats;
+	struct rte_eth_xstat *xstats;
+	struct rte_eth_xstat_name *names; // fetched once, ids do not change while the port runs
+};
+
+static uint16_t stats_ports[RTE_MAX_ETHPORTS];
+static unsigned int stats_nb_ports;
+static struct port_sample samples[RTE_MAX_ETHPORTS];
+static rte_spinlock_t sample_lock = RTE_SPINLOCK_INITIALIZER; // sampler vs telemetry thread
+static volatile bool sampler_running;
+static volatile bool sampler_stop;
+
+static void
+sample_port(uint16_t port)
+{
+	struct port_sample *s = &samples[port];
+	struct rte_eth_stats st;
+	uint64_t now = rte_rdtsc();
+
+	if (pktio_stats_get(port, &st) != 0)
+		return;
+	if (s->tsc != 0 && now > s->tsc) {
+		double sec = (double)(now - s->tsc) / rte_get_tsc_hz();
+		s->rx_pps = (st.ipackets - s->st.ipackets) / sec;
+		s->tx_pps = (st.opackets - s->st.opackets) / sec;
+		s->rx_bps = (st.ibytes - s->st.ibytes) * 8 / sec;
+		s->tx_bps = (st.obytes - s->st.obytes) * 8 / sec;
+	}
+	s->st = st;
+	s->tsc = now;
+	if (s->xstats != NULL)
+		rte_eth_xstats_get(port, s->xstats, s->nb_xstats);
+}
+
+static void
+sample_all(void)
+{
+	rte_spinlock_lock(&sample_lock);
+	for (unsigned int i = 0; i < stats_nb_ports; i++)
+		sample_port(stats_ports[i]);
+	rte_spinlock_unlock(&sample_lock);
+}
+
+/* without a sampler lcore the reader pays for the sample, at most once per interval */
+static void
+sample_if_stale(void)
+{
+	if (sampler_running || stats_nb_ports == 0)
+		return;
+	if (rte_rdtsc() - samples[stats_ports[0]].tsc >= rte_get_tsc_hz() / 1000 * STATS_INTERVAL_MS)
+		sample_all();
+}
+
+static int
+cmd_ports(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+	sample_if_stale();
+	rte_tel_data_start_dict(d);
+	rte_spinlock_lock(&sample_lock);
+	for (unsigned int i = 0; i < stats_nb_ports; i++) {
+		uint16_t port = stats_ports[i];
+		struct port_sample *s = &samples[port];
+		struct rte_tel_data *p = rte_tel_data_alloc();
+		char name[16];
+
+		if (p == NULL)
+			break;
+		rte_tel_data_start_dict(p);
+		rte_tel_data_add_dict_uint(p, "ipackets", s->st.ipackets);
+		rte_tel_data_add_dict_uint(p, "opackets", s->st.opackets);
+		rte_tel_data_add_dict_uint(p, "ibytes", s->st.ibytes);
+		rte_tel_data_add_dict_uint(p, "obytes", s->st.obytes);
+		rte_tel_data_add_dict_uint(p, "imissed", s->st.imissed);
+		rte_tel_data_add_dict_uint(p, "ierrors", s->st.ierrors);
+		rte_tel_data_add_dict_uint(p, "oerrors", s->st.oerrors);
+		rte_tel_data_add_dict_uint(p, "rx_nombuf", s->st.rx_nombuf);
+		rte_tel_data_add_dict_uint(p, "rx_pps", (uint64_t)s->rx_pps);
+		rte_tel_data_add_dict_uint(p, "tx_pps", (uint64_t)s->tx_pps);
+		rte_tel_data_add_dict_uint(p, "rx_bps", (uint64_t)s->rx_bps);
+		rte_tel_data_add_dict_uint(p, "tx_bps", (uint64_t)s->tx_bps);
+		snprintf(name, sizeof(name), "%u", port);
+		rte_tel_data_add_dict_container(d, name, p, 0);
+	}
+	rte_spinlock_unlock(&sample_lock);
+	return 0;
+}
+
+/* non zero xstats of one port from the last sample */
+static int
+cmd_xstats(const char *cmd __rte_unused, const char *params, struct rte_tel_data *d)
+{
+	char *end;
+	long port;
+
+	if (params == NULL || *params == '\0')
+		return -1;
+	port = strtol(params, &end, 10);
+	if (*end != '\0' || port < 0 || port >= RTE_MAX_ETHPORTS || samples[port].xstats == NULL)
+		return -1;
+	sample_if_stale();
+	rte_tel_data_start_dict(d);
+	rte_spinlock_lock(&sample_lock);
+	for (int i = 0; i < samples[port].nb_xstats; i++)
+		if (samples[port].xstats[i].value != 0)
+			rte_tel_data_add_dict_uint(d, samples[port].names[i].name, samples[port].xstats[i].value);
+	rte_spinlock_unlock(&sample_lock);
+	return 0;
+}
+
+/* mbufs in use per port pool and allocation failures per lcore */
+static int
+cmd_pools(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+	uint64_t fail = 0;
+	unsigned int lcore;
+	char name[RTE_MEMPOOL_NAMESIZE + sizeof("_in_use")];
+
+	rte_tel_data_start_dict(d);
+	for (unsigned int i = 0; i < stats_nb_ports; i++) {
+		struct rte_mempool *mp = pool_of_port(stats_ports[i]);
+		if (mp == NULL)
+			continue;
+		snprintf(name, sizeof(name), "%s_in_use", mp->name);
+		rte_tel_data_add_dict_uint(d, name, rte_mempool_in_use_count(mp));
+	}
+	RTE_LCORE_FOREACH(lcore) {
+		uint64_t f = __atomic_load_n(&pool_stats[lcore].alloc_fail, __ATOMIC_RELAXED);
+		snprintf(name, sizeof(name), "alloc_fail_lcore%u", lcore);
+		rte_tel_data_add_dict_uint(d, name, f);
+		fail += f;
+	}
+	rte_tel_data_add_dict_uint(d, "alloc_fail", fail);
+	return 0;
+}
+
+int
+stats_init(const uint16_t *ports, unsigned int nb_ports)
+{
+	for (unsigned int i = 0; i < nb_ports; i++) {
+		uint16_t port = ports[i];
+		struct port_sample *s = &samples[port];
+		int n = rte_eth_xstats_get_names(port, NULL, 0);
+
+		stats_ports[stats_nb_ports++] = port;
+		if (n <= 0)
+			continue;
+		s->names = rte_zmalloc("xstat_names", sizeof(*s->names) * n, 0);
+		s->xstats = rte_zmalloc("xstats", sizeof(*s->xstats) * n, 0);
+		if (s->names == NULL || s->xstats == NULL ||
+			rte_eth_xstats_get_names(port, s->names, n) != n) {
+			printf("port %u: xstats not sampled\n", port);
+			rte_free(s->names);
+			rte_free(s->xstats);
+			s->names = NULL;
+			s->xstats = NULL;
+			continue;
+		}
+		s->nb_xstats = n;
+	}
+	sample_all();
+
+	if (rte_telemetry_register_cmd("/lab1/ports", cmd_ports,
+			"Stats and rates of the used ports") != 0 ||
+		rte_telemetry_register_cmd("/lab1/xstats", cmd_xstats,
+			"Non zero xstats of a port. Parameters: int port_id") != 0 ||
+		rte_telemetry_register_cmd("/lab1/pools", cmd_pools,
+			"Mbufs in use and allocation failures") != 0)
+		return -1;
+	return 0;
+}
+
+int
+stats_register(const char *name, telemetry_cb cb, const char *help)
+{
+	char cmd[64];
+
+	snprintf(cmd, sizeof(cmd), "/lab1/%s", name);
+	return rte_telemetry_register_cmd(cmd, cb, help);
+}
+
+int
+stats_lcore(void *arg __rte_unused)
+{
+	sampler_running = true;
+	while (!sampler_stop) {
+		sample_all();
+		rte_delay_us_sleep(STATS_INTERVAL_MS * 1000);
+	}
+	sampler_running = false;
+	return 0;
+}
+
+void
+stats_stop(void)
+{
+	sampler_stop = true;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 live counters over DPDK telemetry. Port stats and xstats are sampled
+ * off the datapath, by a spare lcore running stats_lcore() or else by the
+ * telemetry thread itself when a client asks, and served as /lab1/ports,
+ * /lab1/xstats,<port> and /lab1/pools. Applications add their own commands
+ * with stats_register(); callbacks only read counters the datapath already
+ * keeps, so a reader never slows the lcores down.
+ *   usertools/dpdk-telemetry.py, then --> /lab1/ports
+ */
+
+#ifndef LAB1_STATS_H
+#define LAB1_STATS_H
+
+#include <stdint.h>
+#include <rte_telemetry.h>
+#include <rte_version.h>
+
+#define STATS_INTERVAL_MS 100
+
+/*
+ * counters a reader loads with __atomic_load_n: each has a single writer,
+ * so a relaxed store of the new value keeps the access atomic without a
+ * locked add on the datapath
+ */
+#define STATS_SET(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define STATS_ADD(x, v) STATS_SET(x, (x) + (v))
+
+/* 23.03 renamed the unsigned dict/array helpers */
+#if RTE_VERSION < RTE_VERSION_NUM(23, 3, 0, 0)
+#define rte_tel_data_add_dict_uint rte_tel_data_add_dict_u64
+#define rte_tel_data_add_array_uint rte_tel_data_add_array_u64
+#define RTE_TEL_UINT_VAL RTE_TEL_U64_VAL
+#endif
+
+/* remember the ports and register the generic commands, before any lcore is launched */
+int stats_init(const uint16_t *ports, unsigned int nb_ports);
+/* an application command under /lab1/, cb as for rte_telemetry_register_cmd */
+int stats_register(const char *name, telemetry_cb cb, const char *help);
+/* sample every STATS_INTERVAL_MS until stats_stop(), for rte_eal_remote_launch */
+int stats_lcore(void *arg);
+void stats_stop(void);
+
+#endif /* LAB1_STATS_H */
@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_bus_vdev.h>
+
+#include "tune.h"
+#include "hist.h"
+#include "pktio.h"
+
+#define TUNE_VDEV "net_ring_lab1tune" // net_ring without args loops tx into rx
+#define TUNE_ETHER_TYPE 0x88b5        // IEEE local experimental
+#define TUNE_FRAME_LEN 64
+#define TUNE_MBUFS 16383              // deepest rings, bursts and the largest cache
+#define TUNE_WARMUP_MS 10
+#define TUNE_RUN_MS 100
+#define TUNE_DRAIN_MS 5
+
+struct tune_hdr {
+	struct rte_ether_hdr eth;
+	uint64_t tsc;
+};
+
+struct tune_result {
+	bool ok;
+	double mpps;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+};
+
+enum knob { K_BURST, K_RING, K_CACHE };
+
+static const unsigned int bursts[] = { 8, 16, 32, 64, 128, 256 };
+static const unsigned int rings[] = { 256, 512, 1024, 2048, 4096 };
+static const unsigned int caches[] = { 0, 64, 128, 256, 512 };
+static const char *const knob_names[] = { "burst", "ring", "cache" };
+
+static struct hist lat;
+static unsigned int nb_runs;
+
+int
+tune_parse(const char *arg, struct tune_params *p)
+{
+	long v[4] = { p->burst, p->rx_ring, p->tx_ring, p->cache };
+	char *end;
+	int i;
+
+	for (i = 0; i < 4 && *arg; i++) {
+		if (*arg != ',') {
+			v[i] = strtol(arg, &end, 10);
+			if (end == arg || v[i] < 0)
+				return -1;
+			arg = end;
+		}
+		if (*arg == ',')
+			arg++;
+		else if (*arg)
+			return -1;
+	}
+	if (*arg)
+		return -1;
+	if (v[0] < 1 || v[0] > TUNE_MAX_BURST || v[1] < v[0] || v[2] < v[0] ||
+	    v[1] > UINT16_MAX || v[2] > UINT16_MAX || v[3] > RTE_MEMPOOL_CACHE_MAX_SIZE)
+		return -1;
+	p->burst = v[0];
+	p->rx_ring = v[1];
+	p->tx_ring = v[2];
+	p->cache = v[3];
+	return 0;
+}
+
+static void
+set_knob(struct tune_params *p, enum knob k, unsigned int v)
+{
+	switch (k) {
+	case K_BURST:
+		p->burst = v;
+		break;
+	case K_RING:
+		p->rx_ring = p->tx_ring = v;
+		break;
+	case K_CACHE:
+		p->cache = v;
+		break;
+	}
+}
+
+static int
+setup_port(uint16_t port, bool lpbk, const struct tune_params *p, struct rte_mempool *mp,
+	   uint16_t *nb_rxd, uint16_t *nb_txd)
+{
+	struct rte_eth_conf conf;
+	int socket = rte_eth_dev_socket_id(port);
+	int ret;
+
+	memset(&conf, 0, sizeof(conf));
+	conf.lpbk_mode = lpbk;
+	rte_eth_dev_stop(port);
+	ret = rte_eth_dev_configure(port, 1, 1, &conf);
+	if (ret != 0)
+		return ret;
+	*nb_rxd = p->rx_ring;
+	*nb_txd = p->tx_ring;
+	ret = rte_eth_dev_adjust_nb_rx_tx_desc(port, nb_rxd, nb_txd);
+	if (ret != 0)
+		return ret;
+	ret = rte_eth_rx_queue_setup(port, 0, *nb_rxd, socket, NULL, mp);
+	if (ret < 0)
+		return ret;
+	ret = rte_eth_tx_queue_setup(port, 0, *nb_txd, socket, NULL);
+	if (ret < 0)
+		return ret;
+	return rte_eth_dev_start(port);
+}
+
+/* loop 64 byte frames stamped with the tsc at tx, only those sent after the warmup count */
+static void
+measure(uint16_t port, struct rte_mempool *mp, unsigned int burst, struct tune_result *r)
+{
+	struct rte_mbuf *pkts[TUNE_MAX_BURST];
+	struct rte_ether_addr mac;
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t warm, end, now, got = 0;
+	unsigned int i, n;
+
+	rte_eth_macaddr_get(port, &mac);
+	hist_reset(&lat);
+	now = rte_rdtsc();
+	warm = now + hz / 1000 * TUNE_WARMUP_MS;
+	end = warm + hz / 1000 * TUNE_RUN_MS;
+	while (now < end) {
+		if (rte_pktmbuf_alloc_bulk(mp, pkts, burst) == 0) {
+			for (i = 0; i < burst; i++) {
+				struct tune_hdr *h = (struct tune_hdr *)rte_pktmbuf_append(pkts[i], TUNE_FRAME_LEN);
+
+				rte_ether_addr_copy(&mac, &h->eth.dst_addr);
+				rte_ether_addr_copy(&mac, &h->eth.src_addr);
+				h->eth.ether_type = rte_cpu_to_be_16(TUNE_ETHER_TYPE);
+				h->tsc = now;
+			}
+			n = rte_eth_tx_burst(port, 0, pkts, burst);
+			if (n < burst)
+				rte_pktmbuf_free_bulk(pkts + n, burst - n);
+		}
+		n = rte_eth_rx_burst(port, 0, pkts, burst);
+		now = rte_rdtsc();
+		for (i = 0; i < n; i++) {
+			const struct tune_hdr *h = rte_pktmbuf_mtod(pkts[i], const struct tune_hdr *);
+
+			if (pkts[i]->data_len >= sizeof(*h) &&
+			    h->eth.ether_type == rte_cpu_to_be_16(TUNE_ETHER_TYPE) && h->tsc >= warm) {
+				hist_add(&lat, now - h->tsc);
+				got++;
+			}
+		}
+		rte_pktmbuf_free_bulk(pkts, n);
+	}
+	// whatever is still looping goes back before the pool does
+	end = now + hz / 1000 * TUNE_DRAIN_MS;
+	while (rte_rdtsc() < end) {
+		n = rte_eth_rx_burst(port, 0, pkts, burst);
+		rte_pktmbuf_free_bulk(pkts, n);
+	}
+	r->ok = got > 0;
+	r->mpps = (double)got * hz / (hz / 1000 * TUNE_RUN_MS) / 1e6;
+	r->p50_ns = hist_quantile(&lat, 0.5) * 1000000000ULL / hz;
+	r->p99_ns = hist_quantile(&lat, 0.99) * 1000000000ULL / hz;
+}
+
+static void
+run_one(uint16_t port, bool lpbk, const struct tune_params *p, struct tune_result *r)
+{
+	char name[RTE_MEMPOOL_NAMESIZE];
+	struct rte_mempool *mp;
+	uint16_t nb_rxd, nb_txd;
+
+	memset(r, 0, sizeof(*r));
+	snprintf(name, sizeof(name), "TUNE_POOL_%u", nb_runs++);
+	mp = rte_pktmbuf_pool_create(name, TUNE_MBUFS, p->cache, 0, RTE_MBUF_DEFAULT_BUF_SIZE,
+				     rte_eth_dev_socket_id(port));
+	if (mp == NULL) {
+		printf("tune: cannot create %s\n", name);
+		return;
+	}
+	if (setup_port(port, lpbk, p, mp, &nb_rxd, &nb_txd) == 0) {
+		measure(port, mp, p->burst, r);
+		printf("tune: burst %3u rx %4u tx %4u cache %3u: %7.3f Mpps, p50 %6" PRIu64 " ns, p99 %6" PRIu64 " ns\n",
+		       p->burst, nb_rxd, nb_txd, p->cache, r->mpps, r->p50_ns, r->p99_ns);
+	} else {
+		printf("tune: burst %u rx %u tx %u cache %u: port %u setup failed\n",
+		       p->burst, p->rx_ring, p->tx_ring, p->cache, port);
+	}
+	rte_eth_dev_stop(port);
+	// a PMD that kept mbufs past stop would hand them back into a freed pool
+	if (rte_mempool_in_use_count(mp) == 0)
+		rte_mempool_free(mp);
+	else
+		printf("tune: %s still has %u mbufs out, kept\n", name, rte_mempool_in_use_count(mp));
+}
+
+/* try every value of one knob on top of p, keep the fastest with a p99 close to the best one */
+static int
+sweep(uint16_t port, bool lpbk, enum knob k, const unsigned int *vals, unsigned int nb,
+      struct tune_params *p)
+{
+	struct tune_result r[8];
+	struct tune_params c = *p;
+	uint64_t min_p99 = UINT64_MAX;
+	int pick = -1;
+	unsigned int i;
+
+	for (i = 0; i < nb; i++) {
+		set_knob(&c, k, vals[i]);
+		if (k == K_RING && vals[i] < c.burst) {
+			r[i].ok = false;
+			continue;
+		}
+		run_one(port, lpbk, &c, &r[i]);
+		if (r[i].ok)
+			min_p99 = RTE_MIN(min_p99, r[i].p99_ns);
+	}
+	for (i = 0; i < nb; i++)
+		if (r[i].ok && r[i].p99_ns <= min_p99 * TUNE_P99_SLACK &&
+		    (pick < 0 || r[i].mpps > r[pick].mpps))
+			pick = i;
+	if (pick < 0)
+		return -1;
+	set_knob(p, k, vals[pick]);
+	printf("tune: %s %u picked, %.3f Mpps at p99 %" PRIu64 " ns\n",
+	       knob_names[k], vals[pick], r[pick].mpps, r[pick].p99_ns);
+	return 0;
+}
+
+int
+tune_run(const char *target, struct tune_params *p)
+{
+	bool loop = !strcmp(target, "loop");
+	uint16_t port;
+	char *end;
+	int ret;
+
+	if (!loop) {
+		unsigned long id = strtoul(target, &end, 10);
+
+		if (end == target || *end || !rte_eth_dev_is_valid_port(id)) {
+			printf("tune: target should be loop or an ethdev port id\n");
+			return -1;
+		}
+		port = id;
+	}
+	if (!loop && pktio_backend != PKTIO_DPDK) {
+		printf("tune: port %u is no ethdev with this backend, tuning on the loopback\n", port);
+		loop = true;
+	}
+	if (!loop) {
+		struct tune_result r;
+
+		// one run tells whether the PMD does MAC loopback at all
+		run_one(port, true, p, &r);
+		if (!r.ok) {
+			printf("tune: no loopback through port %u, tuning on the loopback vdev\n", port);
+			loop = true;
+		}
+	}
+	if (loop) {
+		if (rte_vdev_init(TUNE_VDEV, NULL) != 0 ||
+		    rte_eth_dev_get_port_by_name(TUNE_VDEV, &port) != 0) {
+			printf("tune: cannot create %s, is the net_ring driver loaded?\n", TUNE_VDEV);
+			return -1;
+		}
+	}
+	printf("tune: sweeping on %s\n", loop ? TUNE_VDEV : "the port in MAC loopback");
+
+	ret = sweep(port, !loop, K_BURST, bursts, RTE_DIM(bursts), p);
+	// a software ring has no descriptors to size
+	if (ret == 0 && !loop)
+		ret = sweep(port, true, K_RING, rings, RTE_DIM(rings), p);
+	if (ret == 0)
+		ret = sweep(port, !loop, K_CACHE, caches, RTE_DIM(caches), p);
+
+	if (loop)
+		rte_vdev_uninit(TUNE_VDEV);
+	if (ret != 0) {
+		printf("tune: no candidate got a frame back\n");
+		return -1;
+	}
+	printf("tune: burst %u, rx ring %u, tx ring %u, mbuf cache %u\n",
+	       p->burst, p->rx_ring, p->tx_ring, p->cache);
+	return 0;
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 I/O sizing at runtime: burst, descriptor ring depths and the mempool
+ * cache are parameters instead of build constants. tune_run() picks them for
+ * the host with a short sweep at startup: 64 byte frames are looped back
+ * through a net_ring vdev, or through a real port in MAC loopback, and every
+ * candidate's throughput and latency are logged. Knobs go one at a time,
+ * each keeps the fastest value whose p99 stays within TUNE_P99_SLACK of the
+ * best p99 seen for that knob.
+ */
+
+#ifndef LAB1_TUNE_H
+#define LAB1_TUNE_H
+
+#include <stdint.h>
+
+struct tune_params {
+	unsigned int burst;   // packets per rx/tx burst
+	unsigned int rx_ring; // descriptors per rx queue
+	unsigned int tx_ring; // descriptors per tx queue
+	unsigned int cache;   // per lcore mempool cache
+};
+
+#define TUNE_PARAMS_DEFAULT { 32, 1024, 1024, 250 }
+#define TUNE_MAX_BURST 256 // bounds the on stack burst arrays
+#define TUNE_P99_SLACK 2
+
+/* parse "burst,rx_ring,tx_ring,cache", missing fields keep their value */
+int tune_parse(const char *arg, struct tune_params *p);
+/* sweep on target "loop" or an ethdev port id, before any port is set up; p starts the sweep and gets the pick */
+int tune_run(const char *target, struct tune_params *p);
+
+#endif /* LAB1_TUNE_H */
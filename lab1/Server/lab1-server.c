@@ -2,59 +2,227 @@
  * Copyright(c) 2010-2015 Intel Corporation
  */
 
+#define _GNU_SOURCE // O_DIRECT
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <rte_eal.h>
 #include <rte_ethdev.h>
 #include <rte_cycles.h>
+#include <rte_pause.h>
 #include <rte_lcore.h>
 #include <rte_mbuf.h>
 #include <rte_tcp.h>
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+#include <rte_memcpy.h>
+#include <rte_hash_crc.h>
+#ifdef RTE_ARCH_X86
+#include <rte_vect.h>
+#endif
+
+#include "cksum.h"
+#include "rxidle.h"
+#include "pools.h"
+#include "stats.h"
+#include "probe.h"
+#include "pktio.h"
+#include "tune.h"
+#include "flowrule.h"
+#include "datapath.h"
+#include "pcapio.h"
+#include "rxwin.h"
 
-#define RX_RING_SIZE 1024
-#define TX_RING_SIZE 1024
-
-#define NUM_MBUFS 8191
-#define MBUF_CACHE_SIZE 250
-#define BURST_SIZE 32
 #define PORT_NUM 4
-#define MAX_FLOWS 8
-#define MAX_WIN_SIZE 10
+#define MAX_FLOWS (1 << 20)
+/* flow id travels in both ports: dst carries the low bits, src the high ones */
+#define FLOW_PORT_BASE 5001
+#define FLOW_PORT_BITS 15
+#define MIN_WIN_SIZE 8 // the client assumes this much until the first ack advertises -n
+
+#define SINK_CHUNK (256 * 1024) // bytes per write, a multiple of the block size
+#define SINK_ALIGN 4096
+
+#define PREFETCH_OFFSET 4
+#define IP_PROTO IPPROTO_TCP // next_proto_id the client puts on its segments
+#define TCP_HDR_OFF (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr))
 
 #define SET(x,y) x = x | y
 #define ASSERT(x,y) (x & y) == y
 
-struct rx_window *window_list[MAX_FLOWS]; // pointer array instead of window object array
-size_t conn_num = 0;
+/* LAB1 TCP timestamp option, NOP NOP TS keeps the header 4 bytes aligned */
+#define TCP_OPT_NOP 1
+#define TCP_OPT_TS 8
+#define TCP_OPT_TS_LEN 10
+#define TS_SHIFT 4 // same tick as the client, only tsecr has to be meaningful to it
+#define CLOSED_QUIET (1u << 28) // client ticks after its last segment a closed flow takes seq 0 as retransmitted, ~1.4s at 3GHz
+
+/*
+ * Header fields are in network order and count bytes, like TCP: sent_seq
+ * is the offset of the first payload byte, recv_ack the next byte expected.
+ * rx_win is the window in bytes >> WIN_SHIFT, a fixed scale both ends
+ * know; rounded up, which the client's division back to segments undoes
+ * exactly as long as a segment is at least one unit, so -l is at least
+ * 1 << WIN_SHIFT on both ends. The MTU bounds -l, so 64 segments fit.
+ */
+#define WIN_SHIFT 4
+
+struct tcp_ts_opt {
+	uint8_t nop[2];
+	uint8_t kind;
+	uint8_t len;
+	rte_be32_t tsval;
+	rte_be32_t tsecr;
+} __rte_packed;
+
+/*
+ * LAB1 ECN feedback option, after the timestamp on acks of ECN capable
+ * flows: running counts of ECT and CE marked segments, so the client gets
+ * the exact marked fraction DCTCP wants even when acks are merged or lost.
+ */
+#define TCP_OPT_ECN 254 // RFC 4727 experimental
+#define TCP_OPT_ECN_LEN 10
+
+struct tcp_ecn_opt {
+	uint8_t nop[2];
+	uint8_t kind;
+	uint8_t len;
+	rte_be32_t ect; // segments received ECN capable, CE included
+	rte_be32_t ce;
+} __rte_packed;
+
+/*
+ * LAB1 RPC option, last on a response: the byte offset just past the
+ * request it answers. sent_seq stays the server's own byte stream.
+ */
+#define TCP_OPT_RPC 253 // RFC 4727 experimental
+#define TCP_OPT_RPC_LEN 6
+
+struct tcp_rpc_opt {
+	uint8_t nop[2];
+	uint8_t kind;
+	uint8_t len;
+	rte_be32_t req_end;
+} __rte_packed;
+
+/* LAB1 file CRC option, after the timestamp on the FIN of a file transfer only */
+#define TCP_OPT_CRC 252 // unassigned, both ends are ours
+#define TCP_OPT_CRC_LEN 6
+
+struct tcp_crc_opt {
+	uint8_t nop[2];
+	uint8_t kind;
+	uint8_t len;
+	rte_be32_t crc; // CRC32C of the whole file
+} __rte_packed;
 
-struct rx_window {
-	uint64_t acked; // 10111010001100 [tail-99, head-0]
-	int head;
+/*
+ * Flow state is a structure of arrays on hugepages, allocated once for
+ * MAX_FLOWS: what every packet touches sits in one 32 byte rx_window per
+ * flow (rxwin.h) so it never straddles a cache line, counters live in a
+ * separate cold array.
+ */
+struct rx_stats {
+	uint64_t pkts;
+	uint64_t out_of_window;
+	uint64_t ect; // ECN capable segments, echoed with ce in every ack once non zero
+	uint64_t ce;
+	uint64_t rsp_bytes; // response payload sent, sent_seq of the next one
 };
 
-void init_window(int flow_id) {
-	window_list[flow_id] = (struct rx_window *) malloc(sizeof(struct rx_window));
-	if (window_list[flow_id] == NULL) {
-		printf("cant allocate memory for window\n");
-		return;
+/*
+ * LAB1 file sink: the in-order payload of a flow is staged in an aligned
+ * buffer and written SINK_CHUNK at a time, with O_DIRECT when the file
+ * system takes it. Segments past a hole hold a reference to their mbuf in
+ * a reorder ring until it is filled. A CRC32C over the stream is checked
+ * against the one the client carries in a tcp_crc_opt on its FIN.
+ */
+struct sink {
+	int fd; // -1 for the memory sink, the data is only checksummed
+	uint32_t next; // seq of the next in-order segment
+	uint32_t fill; // staged bytes
+	uint64_t off; // file offset of buf[0]
+	uint32_t crc;
+	uint32_t client_crc;
+	bool have_crc;
+	uint8_t *buf; // SINK_CHUNK, aligned for O_DIRECT
+	struct rte_mbuf *ooo[RXWIN_MAX]; // parked segments by seq % win_size
+	uint32_t ooo_seq[RXWIN_MAX];
+};
+
+struct rx_window *rx_win = NULL;
+struct rx_stats *rx_flow_stats = NULL;
+static bool trace = false; // -v, a line per segment and per flow opened or closed
+static unsigned int win_size = RXWIN_MAX; // -n, segments past the ack a flow may send, a power of two
+size_t conn_num = 0;
+static uint64_t seg_total = 0, oow_total = 0; // over every flow since start, for telemetry
+static const char *sink_path = NULL; // -w, "mem" keeps nothing
+static struct sink **sinks = NULL; // per flow, only while its window is open
+static uint64_t sink_write_errors = 0;
+
+static struct sink *sink_open(int flow_id);
+static void sink_close(int flow_id);
+
+int alloc_windows(void) {
+	rx_win = rte_zmalloc_socket("rx_window", sizeof(*rx_win) * MAX_FLOWS,
+								RTE_CACHE_LINE_SIZE, rte_socket_id());
+	rx_flow_stats = rte_zmalloc_socket("rx_stats", sizeof(*rx_flow_stats) * MAX_FLOWS,
+									   RTE_CACHE_LINE_SIZE, rte_socket_id());
+	if (sink_path != NULL)
+		sinks = rte_zmalloc_socket("sinks", sizeof(*sinks) * MAX_FLOWS, RTE_CACHE_LINE_SIZE, rte_socket_id());
+	if (rx_win == NULL || rx_flow_stats == NULL || (sink_path != NULL && sinks == NULL)) {
+		printf("cant allocate memory for windows\n");
+		return -1;
 	}
-	printf("window for flow#%d is created.\n", flow_id);
-	window_list[flow_id]->head = 0;
-	window_list[flow_id]->acked = 0;
-	conn_num += 1;
+	return 0;
+}
+void init_window(int flow_id) {
+	if (trace)
+		printf("window for flow#%d is created.\n", flow_id);
+	rx_win[flow_id].head = 0;
+	rx_win[flow_id].acked = 0;
+	rx_win[flow_id].psh = 0;
+	rx_win[flow_id].fin_seq = -1;
+	rx_win[flow_id].ts_recent = 0;
+	STATS_SET(rx_win[flow_id].state, WIN_OPEN);
+	// a reused slot starts counting again, stale ECN counts would go out in the first ack
+	STATS_SET(rx_flow_stats[flow_id].pkts, 0);
+	STATS_SET(rx_flow_stats[flow_id].out_of_window, 0);
+	STATS_SET(rx_flow_stats[flow_id].ect, 0);
+	STATS_SET(rx_flow_stats[flow_id].ce, 0);
+	rx_flow_stats[flow_id].rsp_bytes = 0;
+	STATS_ADD(conn_num, 1);
+	if (sinks != NULL)
+		sinks[flow_id] = sink_open(flow_id);
 }
 void release_window(int flow_id) {
-	free(window_list[flow_id]);
-	conn_num -= 1;
-	printf("window for flow#%d is closed.\n", flow_id);
+	if (sinks != NULL)
+		sink_close(flow_id);
+	STATS_SET(rx_win[flow_id].state, WIN_CLOSED);
+	STATS_SET(conn_num, conn_num - 1);
+	if (trace)
+		printf("window for flow#%d is closed.\n", flow_id);
+}
+/*
+ * seq 0 for a closed flow is a retransmission if the client stamped it
+ * within CLOSED_QUIET of the segment that completed the flow, whose tsval
+ * the slot keeps in ts_recent. Later ones start a new flow, TIME-WAIT on
+ * the client's clock. Without timestamps nothing tells them apart.
+ */
+static inline bool closed_rtx(int flow_id, uint32_t tsval) {
+	return tsval != 0 && tsval - rx_win[flow_id].ts_recent < CLOSED_QUIET;
 }
 void visualize(int flow_id) {
-	printf("flow #%d: [%d] ", flow_id, window_list[flow_id]->head);
-	uint64_t bits = window_list[flow_id]->acked;
-	for (int i=0; i<MAX_WIN_SIZE; i++) {
+	printf("flow #%d: [%d] ", flow_id, rx_win[flow_id].head);
+	uint64_t bits = rx_win[flow_id].acked;
+	for (unsigned int i=0; i<win_size; i++) {
 		if (ASSERT(bits, 1)) printf("*");
 		else printf("o");
 		bits = bits >> 1;
@@ -62,66 +230,71 @@ void visualize(int flow_id) {
 	printf("\n");
 }
 
-uint32_t gen_ack(int flow_id) {
-	uint32_t ret = window_list[flow_id]->head - 1;
-	for (int i = 0; i<MAX_WIN_SIZE; i++) {
-		if (ASSERT(window_list[flow_id]->acked, 1)) {
-			window_list[flow_id]->acked = window_list[flow_id]->acked >> 1;
-			ret ++;
-		} else break;
-	}
-	// printf("gen ack bits | ");
-	// visualize(flow_id);
-	window_list[flow_id]->head = ret + 1;
-	return ret;
-}
-void set_ack(int flow_id, uint32_t seq){
-	int index = seq - window_list[flow_id]->head;
-	if ((index < 0) || (index > MAX_WIN_SIZE -1)) {
-		printf("received packet out of window\n");
-		return;
-	}
-	SET(window_list[flow_id]->acked, 1 << index);
-	// printf("set ack bits | ");
-	// visualize(flow_id);
-}
-
-struct rte_mempool *mbuf_pool = NULL;
-static struct rte_ether_addr my_eth;
+static uint16_t used_ports[PORT_NUM]; // every port up to PORT_NUM takes flows
+static uint16_t nb_used_ports = 0;
+static struct rte_ether_addr my_eth[RTE_MAX_ETHPORTS];
 size_t window_len = 10;
 
 int flow_size = 10000;
-int packet_len = 1000;
-int ack_len = 10;
+int packet_len = 1000; // payload per segment, has to match the client's -l
+static uint16_t mtu = RTE_ETHER_MTU;
+static bool gro = false; // merge in-order runs of a burst before window and ack work
+static uint64_t gro_merged = 0; // segments folded into the one before them
+static const int ack_len = 10; // const so the ack build folds it
 int flow_num = 1;
+static bool cksum_bench_only = false;
+static struct rx_idle_conf idle_conf = RX_IDLE_CONF_DEFAULT;
+// burst, rings and mbuf cache, -B or picked by the -A sweep
+static struct tune_params io_params = TUNE_PARAMS_DEFAULT;
+static const char *tune_target;
+static bool rx_intr[RTE_MAX_ETHPORTS]; // port configured with rx queue interrupts
+static enum flowrule_level hw_filter[RTE_MAX_ETHPORTS]; // what the NIC already checked
+static const char *replay_path = NULL; // -P, a capture drives process_burst() instead of ports
+static const char *replay_out = NULL;  // -W, acks and responses of the first pass
+static unsigned int replay_passes = 1;
+static bool replay_timed = false;      // -S, keep the capture's gaps
 
-uint32_t
-checksum(unsigned char *buf, uint32_t nbytes, uint32_t sum)
-{
-	unsigned int	 i;
-
-	/* Checksum all the pairs of bytes first. */
-	for (i = 0; i < (nbytes & ~1U); i += 2) {
-		sum += (uint16_t)ntohs(*((uint16_t *)(buf + i)));
-		if (sum > 0xFFFF)
-			sum -= 0xFFFF;
-	}
-	if (i < nbytes) {
-		sum += buf[i] << 8;
-		if (sum > 0xFFFF)
-			sum -= 0xFFFF;
-	}
+/*
+ * LAB1 RPC mode: a request is the run of segments up to one carrying PSH.
+ * Once the cumulative ack passes it the handler fills a response that
+ * leaves right behind the ack, PSH|ACK with a tcp_rpc_opt naming the
+ * request so the client can match it. Responses are not retransmitted.
+ */
+typedef uint16_t (*rpc_handler_t)(int flow_id, uint32_t end_seq, uint8_t *resp, uint16_t max);
 
-	return sum;
+/* max bytes of a constant pattern */
+static uint16_t
+rpc_fixed(__rte_unused int flow_id, __rte_unused uint32_t end_seq, uint8_t *resp, uint16_t max)
+{
+	memset(resp, 'r', max);
+	return max;
 }
 
-uint32_t
-wrapsum(uint32_t sum)
+/* server TSC, flow and request seq up front, easy to pick out in a capture */
+static uint16_t
+rpc_stamp(int flow_id, uint32_t end_seq, uint8_t *resp, uint16_t max)
 {
-	sum = ~sum & 0xFFFF;
-	return htons(sum);
+	uint64_t stamp[2] = { rte_cpu_to_be_64(rte_rdtsc()),
+						  rte_cpu_to_be_64((uint64_t)flow_id << 32 | end_seq) };
+	uint16_t n = RTE_MIN(max, (uint16_t)sizeof(stamp));
+
+	memcpy(resp, stamp, n);
+	memset(resp + n, 'r', max - n);
+	return max;
 }
 
+static const struct {
+	const char *name;
+	rpc_handler_t fn;
+} rpc_handlers[] = {
+	{ "fixed", rpc_fixed },
+	{ "stamp", rpc_stamp },
+};
+
+static rpc_handler_t rpc_handler = rpc_fixed;
+static uint16_t rpc_resp_len = 0; // response payload, 0 leaves RPC mode off
+static uint64_t rpc_responses = 0;
+
 /*
  * Initializes a given port using global settings and with the RX buffers
  * coming from the mbuf_pool passed as a parameter.
@@ -133,13 +306,16 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 {
 	struct rte_eth_conf port_conf;
 	const uint16_t rx_rings = 1, tx_rings = 1;
-	uint16_t nb_rxd = RX_RING_SIZE;
-	uint16_t nb_txd = TX_RING_SIZE;
+	uint16_t nb_rxd = io_params.rx_ring;
+	uint16_t nb_txd = io_params.tx_ring;
 	int retval;
 	uint16_t q;
 	struct rte_eth_dev_info dev_info;
 	struct rte_eth_txconf txconf;
 
+	if (pktio_backend != PKTIO_DPDK)
+		return pktio_port_init(port, mbuf_pool, mtu, &my_eth[port]);
+
 	if (!rte_eth_dev_is_valid_port(port))
 		return -1;
 
@@ -157,10 +333,39 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 		port_conf.txmode.offloads |=
 			RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE;
 
+	/* jumbo frames larger than one mbuf arrive chained, only the first segment is parsed */
+	if (mtu + RTE_ETHER_HDR_LEN + RTE_ETHER_CRC_LEN > RTE_MBUF_DEFAULT_DATAROOM)
+	{
+		if (!(dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_SCATTER))
+		{
+			printf("port %u: mtu %u needs scattered rx\n", port, mtu);
+			return -ENOTSUP;
+		}
+		port_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_SCATTER;
+	}
+
 	/* Configure the Ethernet device. */
+	rx_idle_port_conf(&idle_conf, &port_conf);
 	retval = rte_eth_dev_configure(port, rx_rings, tx_rings, &port_conf);
+	if (retval != 0 && port_conf.intr_conf.rxq)
+	{
+		// not every PMD does rx interrupts, idle by pausing instead
+		port_conf.intr_conf.rxq = 0;
+		retval = rte_eth_dev_configure(port, rx_rings, tx_rings, &port_conf);
+	}
 	if (retval != 0)
 		return retval;
+	rx_intr[port] = port_conf.intr_conf.rxq;
+
+	if (mtu != RTE_ETHER_MTU)
+	{
+		retval = rte_eth_dev_set_mtu(port, mtu);
+		if (retval != 0)
+		{
+			printf("port %u: cannot set mtu %u (max %u)\n", port, mtu, dev_info.max_mtu);
+			return retval;
+		}
+	}
 
 	retval = rte_eth_dev_adjust_nb_rx_tx_desc(port, &nb_rxd, &nb_txd);
 	if (retval != 0)
@@ -193,13 +398,22 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 		return retval;
 
 	/* Display the port MAC address. */
-	retval = rte_eth_macaddr_get(port, &my_eth);
+	retval = rte_eth_macaddr_get(port, &my_eth[port]);
 	if (retval != 0)
 		return retval;
 
 	printf("Port %u MAC: %02" PRIx8 " %02" PRIx8 " %02" PRIx8
 		   " %02" PRIx8 " %02" PRIx8 " %02" PRIx8 "\n",
-		   port, RTE_ETHER_ADDR_BYTES(&my_eth));
+		   port, RTE_ETHER_ADDR_BYTES(&my_eth[port]));
+
+	/* data dst carries the low bits of the flow id, src the high ones */
+	const struct flowrule_range range = {
+		FLOW_PORT_BASE, FLOW_PORT_BASE + ((MAX_FLOWS - 1) >> FLOW_PORT_BITS),
+		FLOW_PORT_BASE, FLOW_PORT_BASE + (1 << FLOW_PORT_BITS) - 1, 0,
+	};
+	hw_filter[port] = flowrule_install(port, &my_eth[port], IP_PROTO, &range, 1);
+	if (hw_filter[port] != FLOWRULE_NONE)
+		return 0;
 
 	/* Enable RX in promiscuous mode for the Ethernet device. */
 	retval = rte_eth_promiscuous_enable(port);
@@ -211,91 +425,590 @@ port_init(uint16_t port, struct rte_mempool *mbuf_pool)
 }
 /* >8 End of main functional part of port initialization. */
 
-static int get_port(struct sockaddr_in *src,
-                        struct sockaddr_in *dst,
-						uint32_t *seq,
-						uint8_t *flags,
-                        // void **payload,
-                        // size_t *payload_len,
-                        struct rte_mbuf *pkt)
+static inline uint32_t
+ts_now(void) {
+	return (uint32_t)(rte_rdtsc() >> TS_SHIFT);
+}
+
+/* timestamp option of the segment, NULL if it carries none */
+static inline struct tcp_ts_opt *
+get_ts_opt(struct rte_tcp_hdr *tcp_hdr)
 {
-    // packet layout order is (from outside -> in):
-    // ether_hdr
-    // ipv4_hdr
-    // udp_hdr
-    // client timestamp
-    uint8_t *p = rte_pktmbuf_mtod(pkt, uint8_t *);
-    size_t header = 0;
-
-    // check the ethernet header
-    struct rte_ether_hdr * const eth_hdr = (struct rte_ether_hdr *)(p);
-    p += sizeof(*eth_hdr);
-    header += sizeof(*eth_hdr);
-    uint16_t eth_type = ntohs(eth_hdr->ether_type);
-    struct rte_ether_addr mac_addr = {};
-	rte_eth_macaddr_get(1, &mac_addr);
-    if (!rte_is_same_ether_addr(&mac_addr, &eth_hdr->dst_addr) ) {
-        printf("Bad MAC: %02" PRIx8 " %02" PRIx8 " %02" PRIx8
-			   " %02" PRIx8 " %02" PRIx8 " %02" PRIx8 "\n",
-            eth_hdr->dst_addr.addr_bytes[0], eth_hdr->dst_addr.addr_bytes[1],
-			eth_hdr->dst_addr.addr_bytes[2], eth_hdr->dst_addr.addr_bytes[3],
-			eth_hdr->dst_addr.addr_bytes[4], eth_hdr->dst_addr.addr_bytes[5]);
-        return 0;
-    }
-    if (RTE_ETHER_TYPE_IPV4 != eth_type) {
-        printf("Bad ether type\n");
-        return 0;
-    }
-
-    // check the IP header
-    struct rte_ipv4_hdr *const ip_hdr = (struct rte_ipv4_hdr *)(p);
-    p += sizeof(*ip_hdr);
-    header += sizeof(*ip_hdr);
-
-    // In network byte order.
-    in_addr_t ipv4_src_addr = ip_hdr->src_addr;
-    in_addr_t ipv4_dst_addr = ip_hdr->dst_addr;
-
-    if (IPPROTO_IP != ip_hdr->next_proto_id) {
-        printf("Bad next proto_id\n");
-        return 0;
-    }
-    
-    src->sin_addr.s_addr = ipv4_src_addr;
-    dst->sin_addr.s_addr = ipv4_dst_addr;
-
-    // check udp header
-    // struct rte_udp_hdr * const udp_hdr = (struct rte_udp_hdr *)(p);
-	struct rte_tcp_hdr * const tcp_hdr = (struct rte_tcp_hdr *)(p);
-    p += sizeof(*tcp_hdr);
-    header += sizeof(*tcp_hdr);
-
-    // In network byte order.
-    in_port_t tcp_src_port = tcp_hdr->src_port;
-    in_port_t tcp_dst_port = tcp_hdr->dst_port;
-	int ret = 0;
-	
+	if ((tcp_hdr->data_off >> 4) * 4 < sizeof(*tcp_hdr) + sizeof(struct tcp_ts_opt))
+		return NULL;
+	struct tcp_ts_opt *opt = (struct tcp_ts_opt *)(tcp_hdr + 1);
+	if (opt->kind != TCP_OPT_TS || opt->len != TCP_OPT_TS_LEN)
+		return NULL;
+	return opt;
+}
+
+/* file CRC option of a FIN, right behind the timestamp, NULL if it carries none */
+static struct tcp_crc_opt *
+get_crc_opt(struct rte_tcp_hdr *tcp_hdr)
+{
+	if ((tcp_hdr->data_off >> 4) * 4 < sizeof(*tcp_hdr) + sizeof(struct tcp_ts_opt) + sizeof(struct tcp_crc_opt))
+		return NULL;
+	struct tcp_crc_opt *opt = (struct tcp_crc_opt *)((uint8_t *)(tcp_hdr + 1) + sizeof(struct tcp_ts_opt));
+	if (opt->kind != TCP_OPT_CRC || opt->len != TCP_OPT_CRC_LEN)
+		return NULL;
+	return opt;
+}
 
-    for (int i = 1; i < MAX_FLOWS + 1; i++)
-        if (tcp_hdr->dst_port == rte_cpu_to_be_16(5000 + i)) {
-            ret = i;
-            break;
-        }
+static struct sink *
+sink_open(int flow_id)
+{
+	struct sink *s = rte_zmalloc_socket("sink", sizeof(*s), RTE_CACHE_LINE_SIZE, rte_socket_id());
+	if (s == NULL)
+		goto fail;
+	s->buf = rte_malloc_socket("sink_buf", SINK_CHUNK, SINK_ALIGN, rte_socket_id());
+	if (s->buf == NULL)
+		goto fail;
+	s->fd = -1;
+	if (strcmp(sink_path, "mem") != 0) {
+		char name[PATH_MAX];
+		snprintf(name, sizeof(name), "%s.%d", sink_path, flow_id);
+		s->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		if (s->fd < 0 && errno == EINVAL) // file system without O_DIRECT
+			s->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (s->fd < 0) {
+			printf("cannot open %s: %s\n", name, strerror(errno));
+			goto fail;
+		}
+	}
+	return s;
+fail:
+	printf("flow #%d: no sink, its data is dropped\n", flow_id);
+	if (s != NULL)
+		rte_free(s->buf);
+	rte_free(s);
+	return NULL;
+}
+
+/* write out the staged block multiple, everything when final */
+static void
+sink_flush(struct sink *s, bool final)
+{
+	uint32_t n = final ? s->fill : RTE_ALIGN_FLOOR(s->fill, SINK_ALIGN);
+
+	if (s->fd >= 0 && n > 0) {
+		if (final) // the tail is not block sized
+			fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) & ~O_DIRECT);
+		if (pwrite(s->fd, s->buf, n, s->off) != (ssize_t)n)
+			STATS_ADD(sink_write_errors, 1);
+	}
+	s->off += n;
+	memmove(s->buf, s->buf + n, s->fill - n);
+	s->fill -= n;
+}
 
-    src->sin_port = tcp_src_port;
-    dst->sin_port = tcp_dst_port;
-    
-    src->sin_family = AF_INET;
-    dst->sin_family = AF_INET;
+/* stage the payload of the next in-order segment */
+static void
+sink_put(struct sink *s, struct rte_mbuf *m)
+{
+	struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, RTE_ETHER_HDR_LEN);
+	struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)(ip + 1);
+	uint32_t l4_hdr = (tcp->data_off >> 4) * 4;
+	uint32_t off = TCP_HDR_OFF + l4_hdr;
+	uint32_t len = rte_be_to_cpu_16(ip->total_length) - sizeof(*ip) - l4_hdr;
+
+	s->next++;
+	if (off + len > m->pkt_len)
+		return; // truncated, the checksum will tell
+	if (s->fill + len > SINK_CHUNK)
+		sink_flush(s, false);
+	uint8_t *dst = s->buf + s->fill;
+	const uint8_t *src = rte_pktmbuf_read(m, off, len, dst); // copies only if chained
+	if (src != dst)
+		rte_memcpy(dst, src, len);
+	s->crc = rte_hash_crc(dst, len, s->crc);
+	s->fill += len;
+}
 
-	*seq = tcp_hdr->sent_seq;
-	*flags = tcp_hdr->tcp_flags;
+/* a segment the window took, written if in order, parked until the hole fills otherwise */
+static void
+sink_segment(int flow_id, struct rte_mbuf *m, uint32_t seq, uint8_t flags)
+{
+	struct sink *s = sinks[flow_id];
 
-    // *payload_len = pkt->pkt_len - header;
-    // *payload = (void *)p;
-    
-	return ret;
+	if (s == NULL || seq < s->next || seq >= s->next + win_size)
+		return;
+	if (flags & RTE_TCP_FIN_FLAG) {
+		struct tcp_crc_opt *opt = get_crc_opt(rte_pktmbuf_mtod_offset(m, struct rte_tcp_hdr *, TCP_HDR_OFF));
+		if (opt != NULL) {
+			s->client_crc = rte_be_to_cpu_32(opt->crc);
+			s->have_crc = true;
+		}
+	}
+	if (seq != s->next) {
+		uint32_t k = seq & (win_size - 1);
+		if (s->ooo[k] == NULL) {
+			rte_pktmbuf_refcnt_update(m, 1); // the burst frees its own reference
+			s->ooo[k] = m;
+			s->ooo_seq[k] = seq;
+		}
+		return;
+	}
+	sink_put(s, m);
+	for (uint32_t k = s->next & (win_size - 1); s->ooo[k] != NULL && s->ooo_seq[k] == s->next;
+		 k = s->next & (win_size - 1)) {
+		struct rte_mbuf *o = s->ooo[k];
+		s->ooo[k] = NULL;
+		sink_put(s, o);
+		rte_pktmbuf_free(o);
+	}
+}
+
+static void
+sink_close(int flow_id)
+{
+	struct sink *s = sinks[flow_id];
+
+	if (s == NULL)
+		return;
+	sink_flush(s, true);
+	if (s->fd >= 0)
+		close(s->fd);
+	printf("flow #%d: %" PRIu64 " bytes, crc32c %08x %s", flow_id, s->off, s->crc,
+		   !s->have_crc ? "unchecked\n" : s->crc == s->client_crc ? "verified\n" : "MISMATCH");
+	if (s->have_crc && s->crc != s->client_crc)
+		printf(", client sent %08x\n", s->client_crc);
+	for (int k = 0; k < RXWIN_MAX; k++)
+		rte_pktmbuf_free(s->ooo[k]);
+	rte_free(s->buf);
+	rte_free(s);
+	sinks[flow_id] = NULL;
+}
+
+/* hot path stages timed by PROBE_MARK when built with PROBES=1 */
+enum stage { ST_RX, ST_PARSE, ST_GRO, ST_WINDOW, ST_BUILD, ST_CKSUM, ST_RPC, ST_FREE, ST_TX, ST_NB };
+static const char *const stage_names[ST_NB] = {
+	"rx", "parse", "gro", "window", "build", "cksum", "rpc", "free", "tx",
+};
+
+/*
+ * First 32 bytes of a frame we accept: our MAC, IPv4 ethertype, IHL 5 so
+ * the TCP header sits at a fixed offset, and the lab protocol number.
+ * Built once after port_init so the hot path never asks the port for it.
+ */
+static uint8_t hdr_tpl[RTE_MAX_ETHPORTS][32] __rte_aligned(16); // one per port, the MAC differs
+static uint8_t hdr_mask[32] __rte_aligned(16);
+
+static void
+init_parse_template(uint16_t port)
+{
+	uint8_t *tpl = hdr_tpl[port];
+
+	memset(tpl, 0, sizeof(hdr_tpl[port]));
+	memset(hdr_mask, 0, sizeof(hdr_mask));
+	memcpy(tpl, &my_eth[port], RTE_ETHER_ADDR_LEN);
+	memset(hdr_mask, 0xff, RTE_ETHER_ADDR_LEN);
+	tpl[12] = RTE_ETHER_TYPE_IPV4 >> 8;
+	tpl[13] = RTE_ETHER_TYPE_IPV4 & 0xff;
+	hdr_mask[12] = hdr_mask[13] = 0xff;
+	tpl[14] = 0x45;
+	hdr_mask[14] = 0xff;
+	tpl[sizeof(struct rte_ether_hdr) + offsetof(struct rte_ipv4_hdr, next_proto_id)] = IP_PROTO;
+	hdr_mask[sizeof(struct rte_ether_hdr) + offsetof(struct rte_ipv4_hdr, next_proto_id)] = 0xff;
+}
+
+/* MAC, ethertype, IHL and protocol in one masked compare */
+static inline bool
+hdr_match(const uint8_t *p, const uint8_t *tpl)
+{
+#ifdef RTE_ARCH_X86
+	__m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i *)p),
+							   _mm_load_si128((const __m128i *)hdr_mask));
+	__m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i *)(p + 16)),
+							   _mm_load_si128((const __m128i *)(hdr_mask + 16)));
+	__m128i eq = _mm_and_si128(_mm_cmpeq_epi8(lo, _mm_load_si128((const __m128i *)tpl)),
+							   _mm_cmpeq_epi8(hi, _mm_load_si128((const __m128i *)(tpl + 16))));
+	return _mm_movemask_epi8(eq) == 0xffff;
+#else
+	uint64_t w[4], diff = 0;
+	memcpy(w, p, sizeof(w));
+	for (int k = 0; k < 4; k++)
+		diff |= (w[k] & ((const uint64_t *)hdr_mask)[k]) ^ ((const uint64_t *)tpl)[k];
+	return diff == 0;
+#endif
+}
+
+static __rte_always_inline void
+parse_one(struct rte_mbuf *pkt, bool ok, struct seg_desc *d, const uint32_t plen)
+{
+	d->flow_id = -1;
+	if (!ok)
+		return;
+
+	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, TCP_HDR_OFF);
+	int lo = rte_be_to_cpu_16(tcp_hdr->dst_port) - FLOW_PORT_BASE;
+	int hi = rte_be_to_cpu_16(tcp_hdr->src_port) - FLOW_PORT_BASE;
+	if (lo < 0 || lo >= (1 << FLOW_PORT_BITS) || hi < 0 ||
+		((hi << FLOW_PORT_BITS) | lo) >= MAX_FLOWS)
+		return;
 
+	d->flow_id = (hi << FLOW_PORT_BITS) | lo;
+	d->nseg = 1;
+	// byte offset on the wire so TSO can advance it, the window works in segments
+	d->seq = rte_be_to_cpu_32(tcp_hdr->sent_seq) / plen;
+	d->flags = tcp_hdr->tcp_flags;
+	uint8_t ecn = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, RTE_ETHER_HDR_LEN)->type_of_service &
+		RTE_IPV4_HDR_ECN_MASK;
+	d->ect = ecn != 0;
+	d->ce = ecn == RTE_IPV4_HDR_ECN_CE;
+	struct tcp_ts_opt *ts = get_ts_opt(tcp_hdr);
+	d->tsval = ts ? rte_be_to_cpu_32(ts->tsval) : 0;
+}
+
+/*
+ * Parse a whole RX burst into desc[], four frames per round with the
+ * headers of the frames PREFETCH_OFFSET ahead already on their way.
+ */
+static __rte_always_inline void
+parse_burst(uint16_t port, struct rte_mbuf **pkts, uint16_t nb, struct seg_desc *desc, const uint32_t plen)
+{
+	const uint32_t min_len = TCP_HDR_OFF + sizeof(struct rte_tcp_hdr);
+	const uint8_t *tpl = hdr_tpl[port];
+	const bool hw = hw_filter[port] == FLOWRULE_EXACT; // the NIC dropped everything else
+	uint16_t i;
+
+	for (i = 0; i < nb && i < PREFETCH_OFFSET; i++)
+		rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+
+	for (i = 0; i + 4 <= nb; i += 4) {
+		for (int k = 0; k < 4; k++)
+			if (i + k + PREFETCH_OFFSET < nb)
+				rte_prefetch0(rte_pktmbuf_mtod(pkts[i + k + PREFETCH_OFFSET], void *));
+		bool ok0 = pkts[i]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i], uint8_t *), tpl));
+		bool ok1 = pkts[i + 1]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 1], uint8_t *), tpl));
+		bool ok2 = pkts[i + 2]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 2], uint8_t *), tpl));
+		bool ok3 = pkts[i + 3]->data_len >= min_len && (hw || hdr_match(rte_pktmbuf_mtod(pkts[i + 3], uint8_t *), tpl));
+		parse_one(pkts[i], ok0, &desc[i], plen);
+		parse_one(pkts[i + 1], ok1, &desc[i + 1], plen);
+		parse_one(pkts[i + 2], ok2, &desc[i + 2], plen);
+		parse_one(pkts[i + 3], ok3, &desc[i + 3], plen);
+	}
+	for (; i < nb; i++)
+		parse_one(pkts[i], pkts[i]->data_len >= min_len && (hw ||
+				  hdr_match(rte_pktmbuf_mtod(pkts[i], uint8_t *), tpl)), &desc[i], plen);
+}
+
+/* response to the request ending at end_seq, headers copied from the ack just built */
+static struct rte_mbuf *
+build_response(const struct rte_mbuf *ack, int flow_id, uint32_t end_seq, uint32_t plen)
+{
+	struct rte_mbuf *m = pool_alloc();
+	if (unlikely(m == NULL))
+		return NULL;
+
+	const uint16_t ack_hdr = ack->data_len - ack_len;
+	const uint16_t hdr = ack_hdr + sizeof(struct tcp_rpc_opt);
+	uint8_t *p = rte_pktmbuf_mtod(m, uint8_t *);
+	memcpy(p, rte_pktmbuf_mtod(ack, uint8_t *), ack_hdr);
+	struct tcp_rpc_opt *opt = (struct tcp_rpc_opt *)(p + ack_hdr);
+	opt->nop[0] = opt->nop[1] = TCP_OPT_NOP;
+	opt->kind = TCP_OPT_RPC;
+	opt->len = TCP_OPT_RPC_LEN;
+	opt->req_end = rte_cpu_to_be_32((end_seq + 1) * plen);
+	uint16_t len = rpc_handler(flow_id, end_seq, p + hdr, rpc_resp_len);
+
+	struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(p + RTE_ETHER_HDR_LEN);
+	struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)(ip + 1);
+	ip->total_length = rte_cpu_to_be_16(hdr - RTE_ETHER_HDR_LEN + len);
+	ip->hdr_checksum = 0;
+	ip->hdr_checksum = cksum_ipv4_hdr(ip);
+	tcp->sent_seq = rte_cpu_to_be_32((uint32_t)rx_flow_stats[flow_id].rsp_bytes);
+	tcp->data_off += sizeof(*opt) / 4 << 4;
+	tcp->tcp_flags = RTE_TCP_ACK_FLAG | RTE_TCP_PSH_FLAG;
+	tcp->cksum = 0;
+	tcp->cksum = cksum_ipv4_l4(ip, tcp, hdr - RTE_ETHER_HDR_LEN - sizeof(*ip) + len);
+	rx_flow_stats[flow_id].rsp_bytes += len;
+
+	m->l2_len = RTE_ETHER_HDR_LEN;
+	m->l3_len = sizeof(*ip);
+	m->data_len = hdr + len;
+	m->pkt_len = hdr + len;
+	STATS_ADD(rpc_responses, 1);
+	return m;
+}
+
+/*
+ * Window, ack and response work for a burst that came in on port, after
+ * PROBE_BEGIN. The acks and responses go to acks[], every buffer of
+ * bufs[] is freed or kept by a sink; returns how many replies were built.
+ * Template over the segment size, GRO and the window, see the variants
+ * below.
+ */
+static __rte_always_inline uint16_t
+process_burst_tmpl(uint16_t port, struct rte_mbuf **bufs, uint16_t nb_rx, struct rte_mbuf **acks,
+				   const uint32_t plen, const bool g, const unsigned int win)
+{
+	struct rte_mbuf *pkt;
+	struct rte_ether_hdr *eth_h;
+	struct rte_ipv4_hdr *ip_h;
+	struct rte_tcp_hdr *tcp_h;
+	uint16_t i;
+	uint16_t nb_replies = 0;
+
+	uint32_t done[RXWIN_MAX];
+	uint16_t nb_done;
+	uint64_t segs = 0, oow = 0;
+	struct rte_mbuf *ack;
+	// char *buf_ptr;
+	struct rte_ether_hdr *eth_h_ack;
+	struct rte_ipv4_hdr *ip_h_ack;
+	struct rte_tcp_hdr *tcp_h_ack;
+
+	struct seg_desc desc[TUNE_MAX_BURST];
+	parse_burst(port, bufs, nb_rx, desc, plen);
+	PROBE_MARK(ST_PARSE, nb_rx);
+	if (g) {
+		struct rte_mbuf *merged[TUNE_MAX_BURST];
+		uint16_t nb_merged;
+
+		nb_rx = gro_burst(bufs, desc, nb_rx, merged, &nb_merged);
+		rte_pktmbuf_free_bulk(merged, nb_merged);
+		STATS_ADD(gro_merged, nb_merged);
+		PROBE_MARK(ST_GRO, nb_rx);
+	}
+
+	for (i = 0; i < nb_rx; i++)
+	{
+		pkt = bufs[i];
+		uint32_t seq = desc[i].seq;
+		uint16_t nseg = desc[i].nseg;
+		uint8_t flags = desc[i].flags;
+		uint32_t tsval = desc[i].tsval;
+		int flow_id = desc[i].flow_id;
+		int index = flow_id + 1;
+		bool closed = false; // retransmission for a finished flow, only its final ack goes back
+		if (index != 0 && rx_win[flow_id].state != WIN_OPEN) {
+			/*
+			 * a retransmitted seq 0 must not reset a live window. A slot
+			 * opens on the first window of a flow it never saw, or on seq 0
+			 * of a new flow once closed (closed_rtx); anything else for a
+			 * closed flow is a retransmission whose final ack got lost.
+			 */
+			if (rx_win[flow_id].state == WIN_FREE ? seq < win : seq == 0 && !closed_rtx(flow_id, tsval))
+				init_window(flow_id);
+			else if (rx_win[flow_id].state == WIN_CLOSED)
+				closed = true;
+			else
+				index = 0;
+		}
+		if (index != 0 && !closed) {
+			if (unlikely(trace))
+				printf("received: #%d (%u) from flow #%d\n", seq, nseg, flow_id);
+			uint16_t bad = rxwin_mark(&rx_win[flow_id], seq, nseg, win);
+			STATS_ADD(rx_flow_stats[flow_id].pkts, nseg);
+			STATS_ADD(rx_flow_stats[flow_id].ect, desc[i].ect);
+			STATS_ADD(rx_flow_stats[flow_id].ce, desc[i].ce);
+			STATS_ADD(rx_flow_stats[flow_id].out_of_window, bad);
+			segs += nseg;
+			oow += bad;
+			if (sinks != NULL)
+				sink_segment(flow_id, pkt, seq, flags);
+			if (rpc_resp_len && ASSERT(flags, RTE_TCP_PSH_FLAG))
+				rxwin_psh(&rx_win[flow_id], seq + nseg - 1, win);
+			if (ASSERT(flags, RTE_TCP_FIN_FLAG))
+				rx_win[flow_id].fin_seq = seq + nseg - 1;
+			if (tsval != 0)
+				rx_win[flow_id].ts_recent = tsval;
+		} else if (!closed) { // skip bad mac whos return port is 0
+			rte_pktmbuf_free(pkt);
+			continue;
+		}
+
+		eth_h = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
+
+		ip_h = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *,
+									   sizeof(struct rte_ether_hdr));
+
+		tcp_h = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *,
+									   sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) );
+		// rte_pktmbuf_dump(stdout, pkt, pkt->pkt_len);
+
+
+		// window work is done even without an ack to carry it, a closed flow answers a retransmitted FIN
+		uint32_t ack_seq = rx_win[flow_id].head - 1;
+		nb_done = 0;
+		if (!closed) {
+			ack_seq = rxwin_advance(&rx_win[flow_id], done, &nb_done, win);
+			/* close only once everything up to FIN arrived, holes may still be repaired */
+			if (rx_win[flow_id].fin_seq >= 0 && (int)ack_seq == rx_win[flow_id].fin_seq)
+				release_window(flow_id);
+		}
+		// a closed flow keeps its close stamp for closed_rtx, the retransmission is echoed as is
+		uint32_t tsecr = closed && tsval != 0 ? tsval : rx_win[flow_id].ts_recent;
+		PROBE_MARK(ST_WINDOW, 1);
+
+		// Construct and send Acks
+		ack = pool_alloc();
+		if (unlikely(ack == NULL)) {
+			// counted, the next segment or retransmission gets the cumulative ack
+			rte_pktmbuf_free(pkt);
+			continue;
+		}
+		size_t header_size = 0;
+		// ECN capable flows get their mark counts after the timestamp
+		uint16_t opt_len = sizeof(struct tcp_ts_opt) +
+			(rx_flow_stats[flow_id].ect ? sizeof(struct tcp_ecn_opt) : 0);
+
+		uint8_t *ptr = rte_pktmbuf_mtod(ack, uint8_t *);
+		/* add in an ethernet header */
+		eth_h_ack = (struct rte_ether_hdr *)ptr;
+		
+		rte_ether_addr_copy(&my_eth[port], &eth_h_ack->src_addr);
+		rte_ether_addr_copy(&eth_h->src_addr, &eth_h_ack->dst_addr);
+		eth_h_ack->ether_type = rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4);
+		ptr += sizeof(*eth_h_ack);
+		header_size += sizeof(*eth_h_ack);
+
+		/* add in ipv4 header*/
+		ip_h_ack = (struct rte_ipv4_hdr *)ptr;
+		ip_h_ack->version_ihl = 0x45;
+		ip_h_ack->type_of_service = 0x0;
+		ip_h_ack->total_length = rte_cpu_to_be_16(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr)
+												  + opt_len + ack_len);
+		ip_h_ack->packet_id = rte_cpu_to_be_16(1);
+		ip_h_ack->fragment_offset = 0;
+		ip_h_ack->time_to_live = 64;
+		ip_h_ack->next_proto_id = IP_PROTO;
+		ip_h_ack->src_addr = ip_h->dst_addr;
+		ip_h_ack->dst_addr = ip_h->src_addr;
+		header_size += sizeof(*ip_h_ack);
+		ptr += sizeof(*ip_h_ack);
+		
+		/* add in UDP hdr*/
+		tcp_h_ack = (struct rte_tcp_hdr *)ptr;
+		tcp_h_ack->src_port = tcp_h->dst_port;
+		tcp_h_ack->dst_port = tcp_h->src_port;
+		// the server sends no data of its own on a plain ack
+		tcp_h_ack->sent_seq = 0;
+		tcp_h_ack->recv_ack = rte_cpu_to_be_32((ack_seq + 1) * plen);
+		tcp_h_ack->data_off = (sizeof(*tcp_h_ack) + opt_len) / 4 << 4;
+		tcp_h_ack->tcp_flags = 0;
+		SET(tcp_h_ack->tcp_flags, RTE_TCP_ACK_FLAG);
+		// every ack answers its own segments, so ECE echoes exactly the marked ones
+		if (desc[i].ce)
+			SET(tcp_h_ack->tcp_flags, RTE_TCP_ECE_FLAG);
+		tcp_h_ack->rx_win = rte_cpu_to_be_16((win * plen + (1 << WIN_SHIFT) - 1) >> WIN_SHIFT);
+		tcp_h_ack->cksum = 0;
+		tcp_h_ack->tcp_urp = 0;
+		header_size += sizeof(*tcp_h_ack);
+		ptr += sizeof(*tcp_h_ack);
+
+		/* echo the latest client timestamp for its rtt sampling */
+		struct tcp_ts_opt *ts = (struct tcp_ts_opt *)ptr;
+		ts->nop[0] = ts->nop[1] = TCP_OPT_NOP;
+		ts->kind = TCP_OPT_TS;
+		ts->len = TCP_OPT_TS_LEN;
+		ts->tsval = rte_cpu_to_be_32(ts_now());
+		ts->tsecr = rte_cpu_to_be_32(tsecr);
+		header_size += sizeof(*ts);
+		ptr += sizeof(*ts);
+		if (opt_len > sizeof(*ts)) {
+			struct tcp_ecn_opt *ecn = (struct tcp_ecn_opt *)ptr;
+			ecn->nop[0] = ecn->nop[1] = TCP_OPT_NOP;
+			ecn->kind = TCP_OPT_ECN;
+			ecn->len = TCP_OPT_ECN_LEN;
+			ecn->ect = rte_cpu_to_be_32((uint32_t)rx_flow_stats[flow_id].ect);
+			ecn->ce = rte_cpu_to_be_32((uint32_t)rx_flow_stats[flow_id].ce);
+			header_size += sizeof(*ecn);
+			ptr += sizeof(*ecn);
+		}
+		
+		/* set the payload */
+		memset(ptr, 'a', ack_len);
+		PROBE_MARK(ST_BUILD, 1);
+
+		ip_h_ack->hdr_checksum = 0;
+		ip_h_ack->hdr_checksum = cksum_ipv4_hdr(ip_h_ack);
+		tcp_h_ack->cksum = cksum_ipv4_l4(ip_h_ack, tcp_h_ack,
+										 sizeof(*tcp_h_ack) + opt_len + ack_len);
+		PROBE_MARK(ST_CKSUM, 1);
+
+		ack->l2_len = RTE_ETHER_HDR_LEN;
+		ack->l3_len = sizeof(struct rte_ipv4_hdr);
+		// pkt->ol_flags = PKT_TX_IP_CKSUM | PKT_TX_IPV4;
+		ack->data_len = header_size + ack_len;
+		ack->pkt_len = header_size + ack_len;
+		ack->nb_segs = 1;
+		// int pkts_sent = 0;
+
+		// unsigned char *ack_buffer = rte_pktmbuf_mtod(ack, unsigned char *);
+		acks[nb_replies++] = ack;
+		for (uint16_t d = 0; d < nb_done; d++) {
+			struct rte_mbuf *resp = build_response(ack, flow_id, done[d], plen);
+			if (resp != NULL)
+				acks[nb_replies++] = resp;
+		}
+		if (nb_done)
+			PROBE_MARK(ST_RPC, nb_done);
+		
+		rte_pktmbuf_free(bufs[i]);
+		PROBE_MARK(ST_FREE, 1);
+
+	}
+	STATS_ADD(seg_total, segs);
+	STATS_ADD(oow_total, oow);
+	return nb_replies;
+}
+
+typedef uint16_t (*process_burst_t)(uint16_t port, struct rte_mbuf **bufs, uint16_t nb_rx,
+				    struct rte_mbuf **acks);
+
+/* one copy per segment size, GRO setting and window, plen 0 reads packet_len */
+#define PROCESS_VARIANT(plen, g, win) \
+static uint16_t \
+process_burst_##plen##_##g##_##win(uint16_t port, struct rte_mbuf **bufs, uint16_t nb_rx, \
+				   struct rte_mbuf **acks) \
+{ \
+	return process_burst_tmpl(port, bufs, nb_rx, acks, plen ? plen : (uint32_t)packet_len, g, win); \
+}
+#define PROCESS_VARIANT_NOGRO(plen, win) PROCESS_VARIANT(plen, 0, win)
+#define PROCESS_VARIANT_GRO(plen, win) PROCESS_VARIANT(plen, 1, win)
+#define PROCESS_WIN_VARIANTS(win, unused) \
+	PROCESS_VARIANT(0, 0, win) \
+	PROCESS_VARIANT(0, 1, win) \
+	DATAPATH_SEG_SIZES(PROCESS_VARIANT_NOGRO, win) \
+	DATAPATH_SEG_SIZES(PROCESS_VARIANT_GRO, win)
+DATAPATH_WIN_SIZES(PROCESS_WIN_VARIANTS, 0)
+
+#define PROCESS_WIN_ENTRY(win, plen) { win, { process_burst_##plen##_0_##win, process_burst_##plen##_1_##win } },
+#define PROCESS_ENTRY(plen, unused) { plen, { DATAPATH_WIN_SIZES(PROCESS_WIN_ENTRY, plen) } },
+#define PROCESS_WIN_COUNT(win, unused) + 1
+#define PROCESS_NB_WIN (0 DATAPATH_WIN_SIZES(PROCESS_WIN_COUNT, 0))
+static const struct {
+	uint32_t plen;
+	struct {
+		unsigned int win;
+		process_burst_t fn[2]; // by GRO
+	} w[PROCESS_NB_WIN];
+} process_variants[] = {
+	DATAPATH_SEG_SIZES(PROCESS_ENTRY, 0)
+	PROCESS_ENTRY(0, 0) // generic, keep last
+};
+
+static process_burst_t process_burst = process_burst_0_0_64;
+
+/* pick the datapath copy for -l, -G and -n once they are parsed, -n only takes listed windows */
+static void
+datapath_select(void)
+{
+	unsigned int v, k;
+
+	for (v = 0; v < RTE_DIM(process_variants) - 1; v++)
+		if (process_variants[v].plen == (uint32_t)packet_len)
+			break;
+	for (k = 0; k < PROCESS_NB_WIN; k++)
+		if (process_variants[v].w[k].win == win_size)
+			process_burst = process_variants[v].w[k].fn[gro];
+	if (process_variants[v].plen != 0)
+		printf("datapath: specialized for %d byte segments, GRO %s, %u segment window\n",
+		       packet_len, gro ? "on" : "off", win_size);
+	else
+		printf("datapath: generic, no copy for %d byte segments, %u segment window\n", packet_len, win_size);
+	printf("datapath: %s checksum\n", cksum_impl_name());
 }
 
 /* Basic forwarding application lcore. 8< */
@@ -303,8 +1016,6 @@ static __rte_noreturn void
 lcore_main(void)
 {
 	uint16_t port;
-	uint32_t rec = 0;
-	uint16_t nb_rx;
 
 	/*
 	 * Check that the port is on the same NUMA node as the polling thread
@@ -322,168 +1033,329 @@ lcore_main(void)
 	printf("\nCore %u forwarding packets. [Ctrl+C to quit]\n",
 		   rte_lcore_id());
 
+	struct rx_idle idle;
+	rx_idle_init(&idle, &idle_conf);
+	for (uint16_t p = 0; p < nb_used_ports; p++)
+		rx_idle_add(&idle, used_ports[p], 0, rx_intr[used_ports[p]]);
+
 	/* Main work of application loop. 8< */
 	for (;;)
 	{
-		RTE_ETH_FOREACH_DEV(port)
+		uint32_t swept = 0;
+
+		for (uint16_t p = 0; p < nb_used_ports; p++)
 		{
-			/* Get burst of RX packets, from port1 */
-			if (port != 1)
-				continue;
+			/* Get burst of RX packets, acks leave by the port the data came in */
+			port = used_ports[p];
+
+			struct rte_mbuf *bufs[TUNE_MAX_BURST];
+			// every ack may be followed by the responses it completes
+			struct rte_mbuf *acks[TUNE_MAX_BURST * (1 + RXWIN_MAX)];
 
-			struct rte_mbuf *bufs[BURST_SIZE];
-			struct rte_mbuf *pkt;
-			struct rte_ether_hdr *eth_h;
-			struct rte_ipv4_hdr *ip_h;
-			struct rte_tcp_hdr *tcp_h;
-			struct rte_ether_addr eth_addr;
-			uint32_t ip_addr;
-			uint8_t i;
-			uint8_t nb_replies = 0;
-
-			struct rte_mbuf *acks[BURST_SIZE];
-			struct rte_mbuf *ack;
-			// char *buf_ptr;
-			struct rte_ether_hdr *eth_h_ack;
-			struct rte_ipv4_hdr *ip_h_ack;
-			struct rte_tcp_hdr *tcp_h_ack;
-
-			uint16_t nb_rx = rte_eth_rx_burst(port, 0, bufs, BURST_SIZE);
+			PROBE_BEGIN();
+			uint16_t nb_rx = pktio_rx_burst(port, 0, bufs, io_params.burst);
 
+			swept += nb_rx;
 			if (unlikely(nb_rx == 0))
 				continue;
+			PROBE_MARK(ST_RX, nb_rx);
 
-			uint16_t nb_badmac = 0;
-			for (i = 0; i < nb_rx; i++)
-			{
-				pkt = bufs[i];
-				struct sockaddr_in src, dst;
-				uint32_t seq;
-				uint8_t flags;
-                // void *payload = NULL;
-                // size_t payload_length = 0;
-                int index = get_port(&src, &dst, &seq, &flags, pkt);
-				// printf("rv: %u, target port %u ", i, flow_id);
-				int flow_id = index - 1;
-				if(index != 0){
-					printf("received: #%d from flow #%d\n", seq, flow_id);
-					if (seq == 0)
-						init_window(flow_id);
-					set_ack(flow_id, seq);
-				} else { // skip bad mac whos return port is 0
-					rte_pktmbuf_free(pkt);
-					nb_badmac ++; // avoid double free
-					continue;
-				}
-
-				eth_h = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
-				if (eth_h->ether_type != rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4))
-				{
-					rte_pktmbuf_free(pkt);
-					continue;
-				}
-
-				ip_h = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *,
-											   sizeof(struct rte_ether_hdr));
-
-				tcp_h = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *,
-											   sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) );
-				// rte_pktmbuf_dump(stdout, pkt, pkt->pkt_len);
-				rec++;
-
-
-				// Construct and send Acks
-				ack = rte_pktmbuf_alloc(mbuf_pool);
-				if (ack == NULL) {
-					printf("Error allocating tx mbuf\n");
-					return -EINVAL;
-				}
-				size_t header_size = 0;
-
-				uint8_t *ptr = rte_pktmbuf_mtod(ack, uint8_t *);
-				/* add in an ethernet header */
-				eth_h_ack = (struct rte_ether_hdr *)ptr;
-				
-				rte_ether_addr_copy(&my_eth, &eth_h_ack->src_addr);
-				rte_ether_addr_copy(&eth_h->src_addr, &eth_h_ack->dst_addr);
-				eth_h_ack->ether_type = rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4);
-				ptr += sizeof(*eth_h_ack);
-				header_size += sizeof(*eth_h_ack);
-
-				/* add in ipv4 header*/
-				ip_h_ack = (struct rte_ipv4_hdr *)ptr;
-				ip_h_ack->version_ihl = 0x45;
-				ip_h_ack->type_of_service = 0x0;
-				ip_h_ack->total_length = rte_cpu_to_be_16(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) + ack_len);
-				ip_h_ack->packet_id = rte_cpu_to_be_16(1);
-				ip_h_ack->fragment_offset = 0;
-				ip_h_ack->time_to_live = 64;
-				ip_h_ack->next_proto_id = IPPROTO_IP;
-				ip_h_ack->src_addr = ip_h->dst_addr;
-				ip_h_ack->dst_addr = ip_h->src_addr;
-
-				uint32_t ipv4_checksum = wrapsum(checksum((unsigned char *)ip_h_ack, sizeof(struct rte_ipv4_hdr), 0));
-				ip_h_ack->hdr_checksum = rte_cpu_to_be_32(ipv4_checksum);
-				header_size += sizeof(*ip_h_ack);
-				ptr += sizeof(*ip_h_ack);
-				
-				/* add in UDP hdr*/
-				tcp_h_ack = (struct rte_tcp_hdr *)ptr;
-				tcp_h_ack->src_port = tcp_h->dst_port;
-				tcp_h_ack->dst_port = tcp_h->src_port;
-				// no need for seq since server only receives
-				tcp_h_ack->recv_ack = gen_ack(flow_id);
-				if (ASSERT(flags, RTE_TCP_FIN_FLAG))
-					release_window(flow_id);
-				SET(tcp_h_ack->tcp_flags, RTE_TCP_ACK_FLAG);
-				tcp_h_ack->rx_win = 10;
-
-				uint16_t tcp_cksum =  rte_ipv4_udptcp_cksum(ip_h_ack, (void *)tcp_h_ack);
-
-				// printf("Udp checksum is %u\n", (unsigned)udp_cksum);
-				tcp_h_ack->cksum = rte_cpu_to_be_16(tcp_cksum);
-				header_size += sizeof(*tcp_h_ack);
-				ptr += sizeof(*tcp_h_ack);
-				
-				/* set the payload */
-				memset(ptr, 'a', ack_len);
-
-				ack->l2_len = RTE_ETHER_HDR_LEN;
-				ack->l3_len = sizeof(struct rte_ipv4_hdr);
-				// pkt->ol_flags = PKT_TX_IP_CKSUM | PKT_TX_IPV4;
-				ack->data_len = header_size + ack_len;
-				ack->pkt_len = header_size + ack_len;
-				ack->nb_segs = 1;
-				// int pkts_sent = 0;
-
-				// unsigned char *ack_buffer = rte_pktmbuf_mtod(ack, unsigned char *);
-				acks[nb_replies++] = ack;
-				
-				rte_pktmbuf_free(bufs[i]);
-
-			}
-			nb_rx -= nb_badmac;
+			uint16_t nb_replies = process_burst(port, bufs, nb_rx, acks);
 			/* Send back echo replies. */
 			uint16_t nb_tx = 0;
 			if (nb_replies > 0)
 			{
-				nb_tx = rte_eth_tx_burst(port, 0, acks, nb_replies);
+				nb_tx = pktio_tx_burst(port, 0, acks, nb_replies);
 				// printf("%u acks have been replied\n", nb_tx);
 			}
 
 			/* Free any unsent packets. */
-			if (unlikely(nb_tx < nb_rx))
+			if (unlikely(nb_tx < nb_replies))
 			{
 				uint16_t buf;
-				for (buf = nb_tx; buf < nb_rx; buf++)
+				for (buf = nb_tx; buf < nb_replies; buf++)
 					rte_pktmbuf_free(acks[buf]);
 			}
+			PROBE_MARK(ST_TX, nb_tx);
 		}
+		rx_idle_update(&idle, swept);
 	}
 	/* >8 End of loop. */
 }
 /* >8 End Basic forwarding application lcore. */
 
+/*
+ * Offline benchmark of the receive path: the capture sits in hugepage mbufs
+ * and every pass feeds it to process_burst() in bursts, each frame holding
+ * one extra reference so the datapath's free only drops that one. Only
+ * process_burst() is timed, replies are written out (first pass) and freed.
+ */
+/* tsc after the pass start frame i is due, stamps running backwards are due at once */
+static inline uint64_t
+replay_due(const struct pcapio_capture *cap, uint32_t i, double tsc_per_ns)
+{
+	return cap->ts_ns[i] > cap->ts_ns[0] ? (uint64_t)((cap->ts_ns[i] - cap->ts_ns[0]) * tsc_per_ns) : 0;
+}
+
+static void
+replay_run(const struct pcapio_capture *cap, FILE *out)
+{
+	struct rte_mbuf *bufs[TUNE_MAX_BURST];
+	struct rte_mbuf *acks[TUNE_MAX_BURST * (1 + RXWIN_MAX)];
+	const double tsc_per_ns = rte_get_tsc_hz() / 1e9;
+	uint64_t cycles = 0, frames = 0, replies = 0;
+	uint64_t start = rte_rdtsc();
+
+	for (unsigned int pass = 0; pass < replay_passes; pass++) {
+		uint64_t t0 = rte_rdtsc();
+		uint32_t i = 0;
+
+		while (i < cap->nb) {
+			uint16_t n = RTE_MIN((uint32_t)io_params.burst, cap->nb - i);
+
+			if (replay_timed) {
+				// wait for the first frame, the burst takes what else is due by then
+				uint64_t now;
+				while ((now = rte_rdtsc()) - t0 < replay_due(cap, i, tsc_per_ns))
+					rte_pause();
+				uint16_t due = 1;
+				while (due < n && replay_due(cap, i + due, tsc_per_ns) <= now - t0)
+					due++;
+				n = due;
+			}
+			for (uint16_t k = 0; k < n; k++) {
+				bufs[k] = cap->pkts[i + k];
+				rte_pktmbuf_refcnt_update(bufs[k], 1);
+			}
+
+			uint64_t t = rte_rdtsc();
+			PROBE_BEGIN();
+			uint16_t nb_replies = process_burst(0, bufs, n, acks);
+			cycles += rte_rdtsc() - t;
+
+			if (out != NULL && pass == 0)
+				for (uint16_t k = 0; k < nb_replies; k++)
+					pcapio_write(out, acks[k], cap->ts_ns[i + n - 1]);
+			rte_pktmbuf_free_bulk(acks, nb_replies);
+			frames += n;
+			replies += nb_replies;
+			i += n;
+		}
+		// the next pass starts every flow over, on slots it never used
+		for (int f = 0; f < MAX_FLOWS; f++) {
+			if (rx_win[f].state == WIN_OPEN)
+				release_window(f);
+			STATS_SET(rx_win[f].state, WIN_FREE);
+		}
+	}
+
+	double secs = (double)(rte_rdtsc() - start) / rte_get_tsc_hz();
+	printf("\nreplay: %" PRIu64 " frames in %u passes, %" PRIu64 " replies, %.3f s\n",
+		   frames, replay_passes, replies, secs);
+	printf("replay: %.2f cycles per frame, %.3f Mpps in process_burst, %.3f Mpps wall clock\n",
+		   (double)cycles / frames, frames / ((double)cycles / rte_get_tsc_hz()) / 1e6,
+		   frames / secs / 1e6);
+}
+
+static int
+replay(void)
+{
+	struct pcapio_capture cap;
+	FILE *out = NULL;
+	uint32_t i;
+
+	if (pcapio_load(replay_path, rte_socket_id(), &cap) != 0)
+		return -1;
+	// frames arrive on a port 0 owning the MAC they were sent to
+	for (i = 0; i < cap.nb; i++) {
+		const struct rte_ether_hdr *eth = rte_pktmbuf_mtod(cap.pkts[i], const struct rte_ether_hdr *);
+		if (cap.pkts[i]->data_len >= sizeof(*eth) &&
+			eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+			rte_ether_addr_copy(&eth->dst_addr, &my_eth[0]);
+			break;
+		}
+	}
+	if (i == cap.nb) {
+		printf("%s: no IPv4 frame\n", replay_path);
+		return -1;
+	}
+	init_parse_template(0);
+	if (replay_out != NULL && (out = pcapio_create(replay_out)) == NULL) {
+		printf("Cannot create %s\n", replay_out);
+		return -1;
+	}
+	if (alloc_windows() != 0 || probe_init(stage_names, ST_NB) != 0)
+		return -1;
+	replay_run(&cap, out);
+	if (out != NULL)
+		fclose(out);
+	probe_report();
+	return 0;
+}
+
+/* telemetry thread, totals the datapath keeps per burst */
+static int
+tel_flows(const char *cmd __rte_unused, const char *params __rte_unused, struct rte_tel_data *d)
+{
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_uint(d, "active_flows", __atomic_load_n(&conn_num, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "segments", __atomic_load_n(&seg_total, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "out_of_window", __atomic_load_n(&oow_total, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "gro_merged", __atomic_load_n(&gro_merged, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "rpc_responses", __atomic_load_n(&rpc_responses, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "sink_write_errors", __atomic_load_n(&sink_write_errors, __ATOMIC_RELAXED));
+	return 0;
+}
+
+static int
+tel_flow(const char *cmd __rte_unused, const char *params, struct rte_tel_data *d)
+{
+	char *end;
+
+	if (params == NULL || *params == '\0')
+		return -1;
+	long i = strtol(params, &end, 10);
+	if (*end != '\0' || i < 0 || i >= MAX_FLOWS)
+		return -1;
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_uint(d, "active", __atomic_load_n(&rx_win[i].state, __ATOMIC_RELAXED) == WIN_OPEN);
+	rte_tel_data_add_dict_int(d, "head", __atomic_load_n(&rx_win[i].head, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "segments", __atomic_load_n(&rx_flow_stats[i].pkts, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "out_of_window",
+							   __atomic_load_n(&rx_flow_stats[i].out_of_window, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "ect", __atomic_load_n(&rx_flow_stats[i].ect, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_uint(d, "ce", __atomic_load_n(&rx_flow_stats[i].ce, __ATOMIC_RELAXED));
+	return 0;
+}
+
+static void
+usage(const char *prgname)
+{
+	printf("usage: %s [EAL options] -- [-I IO] [-l LEN] [-M MTU] [-G] [-R LEN [-H NAME]] [-w PATH] [-r B,P,S] [-B B,R,T,C] [-A TARGET]\n"
+		   "       [-n SEGS] [-P PCAP [-L PASSES] [-S] [-W OUT]] [-v] [-K]\n"
+		   "  -I IO       packet I/O: dpdk (default, AF_XDP through --vdev net_af_xdp0,iface=IF)\n"
+		   "              or afpacket:IF[,IF...] on kernel interfaces, run the EAL with --no-pci\n"
+		   "  -l LEN      payload bytes per segment, same as the client's (default 1000)\n"
+		   "  -M MTU      port MTU up to 9000 (default 1500)\n"
+		   "  -n SEGS     receive window per flow, a power of two in [8, 64] (default 64)\n"
+		   "  -G          coalesce in-order segments of a burst before acking\n"
+		   "  -R LEN      RPC mode, answer every request with LEN payload bytes\n"
+		   "  -H NAME     RPC handler: fixed (default), stamp\n"
+		   "  -w PATH     write flow N to PATH.N and check its crc, mem only checksums\n"
+		   "  -r B,P,S    rx idling: busy polls, pause us, epoll sleep ms (0 never sleeps)\n"
+		   "  -B B,R,T,C  burst, rx ring, tx ring, mbuf cache (default 32,1024,1024,250)\n"
+		   "  -A TARGET   sweep -B at startup on loop (net_ring vdev) or a port id in MAC loopback\n"
+		   "  -P PCAP     no ports, replay captured client traffic through the datapath and time it\n"
+		   "  -L PASSES   times over the capture (default 1)\n"
+		   "  -S          keep the capture's timing instead of replaying flat out\n"
+		   "  -W OUT      write the acks and responses of the first pass to OUT\n"
+		   "  -v          print a line per received segment, slows the datapath down\n"
+		   "  -K          benchmark the checksum implementations and exit\n",
+		   prgname);
+}
+
+static int
+parse_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "I:l:M:n:GR:H:w:r:B:A:P:L:SW:vK")) != -1) {
+		switch (opt) {
+		case 'I':
+			if (pktio_parse(optarg) != 0)
+				return -1;
+			break;
+		case 'l':
+			packet_len = atoi(optarg);
+			break;
+		case 'M':
+			mtu = (uint16_t)atoi(optarg);
+			break;
+		case 'n':
+			win_size = (unsigned int)atoi(optarg);
+			if (!rte_is_power_of_2(win_size) || win_size < MIN_WIN_SIZE || win_size > RXWIN_MAX)
+				return -1;
+			break;
+		case 'G':
+			gro = true;
+			break;
+		case 'R':
+			rpc_resp_len = (uint16_t)atoi(optarg);
+			if (rpc_resp_len == 0)
+				return -1;
+			break;
+		case 'H': {
+			unsigned int h;
+			for (h = 0; h < RTE_DIM(rpc_handlers); h++)
+				if (!strcmp(optarg, rpc_handlers[h].name))
+					break;
+			if (h == RTE_DIM(rpc_handlers))
+				return -1;
+			rpc_handler = rpc_handlers[h].fn;
+			break;
+		}
+		case 'w':
+			sink_path = optarg;
+			break;
+		case 'r':
+			if (rx_idle_parse(optarg, &idle_conf) != 0)
+				return -1;
+			break;
+		case 'B':
+			if (tune_parse(optarg, &io_params) != 0)
+				return -1;
+			break;
+		case 'A':
+			tune_target = optarg;
+			break;
+		case 'P':
+			replay_path = optarg;
+			break;
+		case 'L':
+			replay_passes = atoi(optarg);
+			if (replay_passes < 1)
+				return -1;
+			break;
+		case 'S':
+			replay_timed = true;
+			break;
+		case 'W':
+			replay_out = optarg;
+			break;
+		case 'v':
+			trace = true;
+			break;
+		case 'K':
+			cksum_bench_only = true;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (mtu < RTE_ETHER_MIN_MTU || mtu > 9000)
+		return -1;
+	// the client's data segments, the FIN with its CRC option the longest
+	const int seg_hdrs = sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + sizeof(struct tcp_ts_opt) +
+		sizeof(struct tcp_crc_opt);
+	if (packet_len < (1 << WIN_SHIFT) || packet_len + seg_hdrs > mtu) {
+		printf("packet_len should be at least %d and fit the mtu with %d bytes of headers\n",
+		       1 << WIN_SHIFT, seg_hdrs);
+		return -1;
+	}
+	if (sink_path != NULL && gro) {
+		printf("-G frees the segments it merges, the sink needs each one\n");
+		return -1;
+	}
+	// a response is a single frame in a single mbuf, with every option an ack may carry and its own
+	const int hdrs = sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + sizeof(struct tcp_ts_opt) +
+		sizeof(struct tcp_ecn_opt) + sizeof(struct tcp_rpc_opt);
+	if (rpc_resp_len + hdrs > mtu || RTE_ETHER_HDR_LEN + hdrs + rpc_resp_len > RTE_MBUF_DEFAULT_DATAROOM) {
+		printf("rpc response + %d bytes of headers should fit the mtu and one mbuf\n", hdrs);
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * The main function, which does initialization and calls the per-lcore
  * functions.
@@ -491,7 +1363,6 @@ lcore_main(void)
 int main(int argc, char *argv[])
 {
 	// struct rte_mempool *mbuf_pool;
-	unsigned nb_ports = 1;
 	uint16_t portid;
 	
 	/* Initializion the Environment Abstraction Layer (EAL). 8< */
@@ -504,22 +1375,71 @@ int main(int argc, char *argv[])
 	argc -= ret;
 	argv += ret;
 
-	nb_ports = rte_eth_dev_count_avail();
-	/* Allocates mempool to hold the mbufs. 8< */
-	mbuf_pool = rte_pktmbuf_pool_create("MBUF_POOL", NUM_MBUFS * nb_ports,
-										MBUF_CACHE_SIZE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
-	/* >8 End of allocating mempool to hold mbuf. */
+	/* application arguments follow the EAL ones */
+	argv[0] = argv[-ret];
+	if (parse_args(argc, argv) != 0) {
+		usage(argv[0]);
+		rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+	}
 
-	if (mbuf_pool == NULL)
-		rte_exit(EXIT_FAILURE, "Cannot create mbuf pool\n");
+	cksum_init();
+	if (cksum_bench_only) {
+		cksum_bench();
+		rte_eal_cleanup();
+		return 0;
+	}
+	// before any port is set up, the sweep reconfigures the one it runs on
+	if (tune_target != NULL && tune_run(tune_target, &io_params) != 0)
+		rte_exit(EXIT_FAILURE, "Autotune failed\n");
+	datapath_select();
+
+	// a replay needs no port
+	if (replay_path == NULL) {
+		PKTIO_FOREACH_PORT(portid)
+		if (nb_used_ports < PORT_NUM)
+			used_ports[nb_used_ports++] = portid;
+		if (nb_used_ports == 0)
+			rte_exit(EXIT_FAILURE, "No usable port\n");
+	}
+
+	/* per socket pools sized by rings and bursts, acks and responses never outlive their burst */
+	struct pool_sizing sz = { io_params.rx_ring, io_params.tx_ring, io_params.burst, io_params.cache,
+							  // one mbuf per response
+							  rpc_resp_len ? (uint64_t)io_params.burst * win_size * RTE_MBUF_DEFAULT_DATAROOM : 0 };
+	if (pools_create(used_ports, nb_used_ports, &sz) != 0)
+		rte_exit(EXIT_FAILURE, "Cannot create mbuf pools\n");
+	if (replay_path != NULL) {
+		ret = replay();
+		rte_eal_cleanup();
+		return ret == 0 ? 0 : EXIT_FAILURE;
+	}
 
 	/* Initializing all ports. 8< */
-	RTE_ETH_FOREACH_DEV(portid)
-	if (portid == 1 && port_init(portid, mbuf_pool) != 0)
-		rte_exit(EXIT_FAILURE, "Cannot init port %" PRIu16 "\n",
-				 portid);
+	for (uint16_t p = 0; p < nb_used_ports; p++)
+	{
+		portid = used_ports[p];
+		if (port_init(portid, pool_of_port(portid)) != 0)
+			rte_exit(EXIT_FAILURE, "Cannot init port %" PRIu16 "\n",
+					 portid);
+		init_parse_template(portid);
+	}
 	/* >8 End of initializing all ports. */
 
+	if (alloc_windows() != 0)
+		rte_exit(EXIT_FAILURE, "Cannot allocate flow windows\n");
+
+	if (stats_init(used_ports, nb_used_ports) != 0 ||
+		stats_register("flows", tel_flows, "Totals over every flow since start") != 0 ||
+		stats_register("flow", tel_flow, "Window of one flow. Parameters: int flow_id") != 0)
+		printf("telemetry commands not registered, is telemetry disabled?\n");
+	// the server never returns, its stage probes are read through /lab1/probes
+	if (probe_init(stage_names, ST_NB) != 0)
+		rte_exit(EXIT_FAILURE, "Cannot init stage probes\n");
+	// a spare lcore samples NIC stats, the telemetry thread does when a reader asks otherwise
+	unsigned int stats_id = rte_get_next_lcore(-1, 1, 0);
+	if (stats_id < RTE_MAX_LCORE)
+		rte_eal_remote_launch(stats_lcore, NULL, stats_id);
+
 	// if (rte_lcore_count() > 1)
 	// 	printf("\nWARNING: Too many lcores enabled. Only 1 used.\n");
 
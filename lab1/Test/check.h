@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * LAB1 unit test helpers: CHECK() reports a failed condition and carries
+ * on, main() returns check_result() so make check stops on the first test
+ * program that saw one.
+ */
+
+#ifndef LAB1_CHECK_H
+#define LAB1_CHECK_H
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(c) do { \
+	if (!(c)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+		check_failures++; \
+	} \
+} while (0)
+
+static inline int
+check_result(const char *name)
+{
+	printf("%s: %s\n", name, check_failures ? "FAIL" : "ok");
+	return check_failures != 0;
+}
+
+#endif /* LAB1_CHECK_H */
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/* checksum test vectors, every implementation the CPU supports */
+
+#include <stdlib.h>
+#include <string.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+
+#include "cksum.h"
+#include "check.h"
+
+// byte wise RFC 1071 reference the implementations are checked against
+static uint16_t
+ref_cksum(const uint8_t *p, size_t len)
+{
+	uint32_t sum = 0;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	if (len & 1)
+		sum += p[len - 1] << 8;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+static uint16_t
+host_cksum(cksum_raw_t fn, const void *buf, size_t len)
+{
+	return rte_be_to_cpu_16(~cksum_fold(fn(buf, len, 0)));
+}
+
+static void
+check_impl(const char *name, cksum_raw_t fn)
+{
+	/* RFC 1071 section 3 example and a captured IPv4 header (checksum 0xb861) */
+	static const uint8_t rfc1071[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+	static const uint8_t ipv4[] = {
+		0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+		0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7,
+	};
+	static uint8_t buf[9000 + 64];
+	unsigned int seed = 740;
+	size_t len, off;
+	int bad = 0;
+
+	printf("cksum %s\n", name);
+	CHECK(host_cksum(fn, rfc1071, sizeof(rfc1071)) == (uint16_t)~0xddf2);
+	CHECK(host_cksum(fn, ipv4, sizeof(ipv4)) == 0xb861);
+
+	// every alignment, odd tails and jumbo lengths against the reference
+	for (off = 0; off < sizeof(buf); off++)
+		buf[off] = (uint8_t)rand_r(&seed);
+	memset(buf, 0xff, 128);
+	for (len = 0; len <= 9000; len += (len < 256 ? 1 : 97)) {
+		for (off = 0; off < 32; off += (len < 256 ? 1 : 7)) {
+			uint16_t got = host_cksum(fn, buf + off, len);
+
+			if (got != ref_cksum(buf + off, len) && bad++ < 4)
+				printf("cksum %s: len %zu offset %zu gives 0x%04x, expected 0x%04x\n",
+					name, len, off, got, ref_cksum(buf + off, len));
+		}
+	}
+	CHECK(bad == 0);
+}
+
+/* incremental update has to agree with a full recompute */
+static void
+check_update(void)
+{
+	uint8_t hdr[20] = {
+		0x45, 0x00, 0x00, 0x73, 0x12, 0x34, 0x40, 0x00, 0x40, 0x06,
+		0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7,
+	};
+	uint16_t c, o16, n16;
+	uint32_t o32, n32;
+
+	c = cksum_buf(hdr, sizeof(hdr));
+	memcpy(&o16, hdr + 2, 2);
+	hdr[3] = 0x28;
+	memcpy(&n16, hdr + 2, 2);
+	c = cksum_update16(c, o16, n16);
+	memcpy(&o32, hdr + 16, 4);
+	hdr[19] = 0x02;
+	memcpy(&n32, hdr + 16, 4);
+	c = cksum_update32(c, o32, n32);
+	CHECK(c == cksum_buf(hdr, sizeof(hdr)));
+}
+
+/* a chain split at odd offsets sums like the flat buffer */
+static void
+check_mbuf(void)
+{
+	static uint8_t data[3000];
+	struct rte_mbuf segs[3];
+	const uint16_t lens[3] = { 1001, 998, 1001 };
+	uint32_t off = 0;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (uint8_t)(i * 7 + 3);
+	memset(segs, 0, sizeof(segs));
+	for (i = 0; i < 3; i++) {
+		segs[i].buf_addr = data + off;
+		segs[i].data_len = lens[i];
+		segs[i].next = i < 2 ? &segs[i + 1] : NULL;
+		off += lens[i];
+	}
+	segs[0].pkt_len = off;
+	CHECK(cksum_fold(cksum_raw_mbuf(&segs[0], 0, off, 0)) ==
+	      cksum_fold(cksum_raw(data, off, 0)));
+	CHECK(cksum_fold(cksum_raw_mbuf(&segs[0], 1003, 1500, 0)) ==
+	      cksum_fold(cksum_raw(data + 1003, 1500, 0)));
+}
+
+int
+main(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < cksum_impl_count(); i++) {
+		const char *name;
+		cksum_raw_t fn = cksum_impl_get(i, &name);
+
+		if (fn != NULL)
+			check_impl(name, fn);
+		else
+			printf("cksum %s: not supported by this CPU, skipped\n", name);
+	}
+	cksum_init();
+	check_update();
+	check_mbuf();
+	return check_result("test-cksum");
+}
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/* client scheduler queues: FIFO lists, the min-heap and the timer wheel */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flowq.h"
+#include "check.h"
+
+#define NB_IDS 1000
+
+static void
+check_fifo(void)
+{
+	struct flowq_fifo q;
+	void *mem = malloc(flowq_fifo_memsize(NB_IDS, 4));
+	uint32_t id, n;
+
+	flowq_fifo_init(&q, mem, NB_IDS, 4);
+	CHECK(flowq_fifo_pop_first(&q) == FLOWQ_NONE);
+	flowq_fifo_push(&q, 2, 7);
+	flowq_fifo_push(&q, 3, 1);
+	flowq_fifo_push(&q, 2, 5);
+	flowq_fifo_push(&q, 0, 9);
+	CHECK(flowq_fifo_pop_first(&q) == 9);
+	CHECK(flowq_fifo_pop_first(&q) == 7);
+	CHECK(flowq_fifo_pop_first(&q) == 5);
+	CHECK(flowq_fifo_pop(&q, 2) == FLOWQ_NONE);
+	CHECK(flowq_fifo_pop_first(&q) == 1);
+	CHECK(q.busy == 0);
+
+	/* round robin: pop, push back */
+	for (id = 0; id < NB_IDS; id++)
+		flowq_fifo_push(&q, 1, id);
+	for (n = 0; n < 3 * NB_IDS; n++) {
+		id = flowq_fifo_pop(&q, 1);
+		CHECK(id == n % NB_IDS);
+		flowq_fifo_push(&q, 1, id);
+	}
+
+	/* a taken list can be refilled while walking it */
+	id = flowq_fifo_take(&q, 1);
+	CHECK(flowq_fifo_pop(&q, 1) == FLOWQ_NONE);
+	for (n = 0; id != FLOWQ_NONE; n++) {
+		uint32_t next = flowq_fifo_next(&q, id);
+
+		if (id % 2)
+			flowq_fifo_push(&q, 1, id);
+		id = next;
+	}
+	CHECK(n == NB_IDS);
+	for (n = 0; (id = flowq_fifo_pop(&q, 1)) != FLOWQ_NONE; n++)
+		CHECK(id == 2 * n + 1);
+	CHECK(n == NB_IDS / 2);
+	free(mem);
+}
+
+static void
+check_heap(void)
+{
+	struct flowq_heap h;
+	void *mem = malloc(flowq_heap_memsize(NB_IDS));
+	uint64_t last = 0;
+	uint32_t id, n;
+
+	flowq_heap_init(&h, mem, NB_IDS);
+	CHECK(flowq_heap_pop(&h) == FLOWQ_NONE);
+	for (id = 0; id < NB_IDS; id++)
+		flowq_heap_push(&h, id, (id * 7919) % 101);
+	for (n = 0; (id = flowq_heap_pop(&h)) != FLOWQ_NONE; n++) {
+		uint64_t key = (id * 7919) % 101;
+
+		CHECK(key >= last);
+		last = key;
+	}
+	CHECK(n == NB_IDS && flowq_heap_empty(&h));
+
+	/* equal keys come out first in first out, like round robin */
+	for (id = 0; id < 10; id++)
+		flowq_heap_push(&h, id, 5);
+	for (n = 0; n < 30; n++) {
+		id = flowq_heap_pop(&h);
+		CHECK(id == n % 10);
+		flowq_heap_push(&h, id, 5);
+	}
+	/* also across a wrap of the insertion count */
+	while (flowq_heap_pop(&h) != FLOWQ_NONE)
+		;
+	h.order = UINT32_MAX - 2;
+	for (id = 0; id < 6; id++)
+		flowq_heap_push(&h, id, 1);
+	for (id = 0; id < 6; id++)
+		CHECK(flowq_heap_pop(&h) == id);
+	free(mem);
+}
+
+static void
+check_wheel(void)
+{
+	struct flowq_wheel w;
+	void *mem = malloc(flowq_wheel_memsize(NB_IDS, 16));
+	uint32_t ids[NB_IDS], n, i;
+
+	flowq_wheel_init(&w, mem, NB_IDS, 16, 10, 1000);
+	CHECK(flowq_wheel_expire(&w, 5000, ids, NB_IDS) == 0);
+	flowq_wheel_arm(&w, 1, 5025);
+	flowq_wheel_arm(&w, 2, 5020);
+	flowq_wheel_arm(&w, 3, 5000 + 16 * 10 + 20); // a turn later, same slot
+	flowq_wheel_arm(&w, 4, 100); // past, next expire
+	CHECK(flowq_wheel_armed(&w, 1) && !flowq_wheel_armed(&w, 0));
+	n = flowq_wheel_expire(&w, 5001, ids, NB_IDS);
+	CHECK(n == 1 && ids[0] == 4);
+	n = flowq_wheel_expire(&w, 5024, ids, NB_IDS);
+	CHECK(n == 1 && ids[0] == 2);
+	CHECK(!flowq_wheel_armed(&w, 2));
+	n = flowq_wheel_expire(&w, 5100, ids, NB_IDS);
+	CHECK(n == 1 && ids[0] == 1);
+	CHECK(flowq_wheel_armed(&w, 3));
+
+	/* re-arming moves the timer, cancel drops it */
+	flowq_wheel_arm(&w, 3, 5110);
+	flowq_wheel_arm(&w, 5, 5150);
+	flowq_wheel_cancel(&w, 5);
+	n = flowq_wheel_expire(&w, 5200, ids, NB_IDS);
+	CHECK(n == 1 && ids[0] == 3);
+
+	/* a long pause fires everything due, n at a time */
+	for (i = 0; i < NB_IDS; i++)
+		flowq_wheel_arm(&w, i, 6000 + i * 37);
+	for (n = 0, i = 0; (i = flowq_wheel_expire(&w, 1000000, ids, 64)) != 0; n += i)
+		CHECK(i <= 64);
+	CHECK(n == NB_IDS);
+	for (i = 0; i < NB_IDS; i++)
+		CHECK(!flowq_wheel_armed(&w, i));
+	free(mem);
+}
+
+int
+main(void)
+{
+	check_fifo();
+	check_heap();
+	check_wheel();
+	return check_result("test-flowq");
+}
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/* pcap writer and record reader, host and swapped byte order, us and ns */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+
+#include "pcapio.h"
+#include "check.h"
+
+static char path[] = "/tmp/lab1-test-pcapio-XXXXXX";
+
+static void
+write_raw(const uint32_t *words, size_t n, bool swap)
+{
+	FILE *f = fopen(path, "wb");
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		uint32_t w = swap ? rte_bswap32(words[i]) : words[i];
+
+		fwrite(&w, sizeof(w), 1, f);
+	}
+	fclose(f);
+}
+
+/* what pcapio_write() produces reads back frame by frame, chains flattened */
+static void
+check_roundtrip(void)
+{
+	uint8_t data[100];
+	struct rte_mbuf segs[2];
+	struct pcapio_reader r;
+	struct pcapio_rec rec;
+	uint8_t got[100];
+	FILE *f;
+	int k;
+
+	for (k = 0; k < (int)sizeof(data); k++)
+		data[k] = (uint8_t)k;
+	memset(segs, 0, sizeof(segs));
+	segs[0].buf_addr = data;
+	segs[0].data_len = 60;
+	segs[0].pkt_len = 100;
+	segs[0].next = &segs[1];
+	segs[1].buf_addr = data + 50; // data_off skips to byte 60
+	segs[1].data_off = 10;
+	segs[1].data_len = 40;
+
+	f = pcapio_create(path);
+	CHECK(f != NULL);
+	if (f == NULL)
+		return;
+	CHECK(pcapio_write(f, &segs[0], 1500000007ULL) == 0);
+	segs[0].next = NULL;
+	segs[0].pkt_len = 60;
+	CHECK(pcapio_write(f, &segs[0], 2000000000ULL) == 0);
+	fclose(f);
+
+	CHECK(pcapio_open(&r, path) == 0);
+	if (r.f == NULL)
+		return;
+	CHECK(!r.swap && r.ns);
+	CHECK(pcapio_next(&r, &rec) == 0);
+	CHECK(rec.caplen == 100 && rec.len == 100 && rec.ts_ns == 1500000007ULL);
+	CHECK(fread(got, 1, rec.caplen, r.f) == rec.caplen && memcmp(got, data, 100) == 0);
+	CHECK(pcapio_next(&r, &rec) == 0);
+	CHECK(rec.caplen == 60 && rec.ts_ns == 2000000000ULL);
+	CHECK(pcapio_skip(&r, &rec) == 0);
+	CHECK(pcapio_next(&r, &rec) == 1);
+	CHECK(pcapio_rewind(&r) == 0);
+	CHECK(pcapio_next(&r, &rec) == 0 && rec.caplen == 100);
+	pcapio_close(&r);
+}
+
+/* microsecond capture from a host of the other byte order, cut by its snaplen */
+static void
+check_swapped_us(void)
+{
+	const uint32_t words[] = {
+		0xa1b2c3d4, 2 | 4 << 16, 0, 0, 64, 1,
+		3, 250, 4, 60, 0xdeadbeef,
+	};
+	struct pcapio_reader r;
+	struct pcapio_rec rec;
+
+	write_raw(words, RTE_DIM(words), true);
+	CHECK(pcapio_open(&r, path) == 0);
+	if (r.f == NULL)
+		return;
+	CHECK(r.swap && !r.ns);
+	CHECK(pcapio_next(&r, &rec) == 0);
+	CHECK(rec.caplen == 4 && rec.len == 60 && rec.ts_ns == 3000250000ULL);
+	CHECK(pcapio_skip(&r, &rec) == 0);
+	CHECK(pcapio_next(&r, &rec) == 1);
+	pcapio_close(&r);
+}
+
+static void
+check_broken(void)
+{
+	const uint32_t truncated[] = { 0xa1b23c4d, 2 | 4 << 16, 0, 0, 65535, 1, 1, 2 };
+	const uint32_t huge[] = { 0xa1b23c4d, 2 | 4 << 16, 0, 0, 65535, 1, 1, 2, 65535, 65535 };
+	const uint32_t not_ether[] = { 0xa1b23c4d, 2 | 4 << 16, 0, 0, 65535, 101 };
+	const uint32_t not_pcap[] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 1, 0, 0 };
+	struct pcapio_reader r;
+	struct pcapio_rec rec;
+
+	write_raw(truncated, RTE_DIM(truncated), false);
+	CHECK(pcapio_open(&r, path) == 0);
+	CHECK(r.f != NULL && pcapio_next(&r, &rec) == -1);
+	pcapio_close(&r);
+
+	write_raw(huge, RTE_DIM(huge), false);
+	CHECK(pcapio_open(&r, path) == 0);
+	CHECK(r.f != NULL && pcapio_next(&r, &rec) == -1);
+	pcapio_close(&r);
+
+	write_raw(not_ether, RTE_DIM(not_ether), false);
+	CHECK(pcapio_open(&r, path) == -1 && r.f == NULL);
+	write_raw(not_pcap, RTE_DIM(not_pcap), false);
+	CHECK(pcapio_open(&r, path) == -1 && r.f == NULL);
+	write_raw(not_pcap, 2, false);
+	CHECK(pcapio_open(&r, path) == -1 && r.f == NULL);
+}
+
+int
+main(void)
+{
+	int fd = mkstemp(path);
+
+	if (fd < 0) {
+		printf("test-pcapio: cannot create %s\n", path);
+		return 1;
+	}
+	close(fd);
+	check_roundtrip();
+	check_swapped_us();
+	check_broken();
+	unlink(path);
+	return check_result("test-pcapio");
+}
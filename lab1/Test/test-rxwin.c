@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/* server receive window: marking, cumulative ack, request ends and GRO */
+
+#include <string.h>
+#include <rte_common.h>
+
+#include "rxwin.h"
+#include "check.h"
+
+static void
+check_in_order(unsigned int win)
+{
+	struct rx_window w = { 0 };
+	uint32_t done[RXWIN_MAX];
+	uint16_t nb_done;
+	uint32_t seq;
+
+	for (seq = 0; seq < 3 * win; seq++) {
+		CHECK(rxwin_mark(&w, seq, 1, win) == 0);
+		CHECK(rxwin_advance(&w, done, &nb_done, win) == seq);
+		CHECK(nb_done == 0);
+	}
+	CHECK(w.acked == 0 && w.head == (int)(3 * win));
+}
+
+/* a hole holds the ack back, filling it releases everything behind it */
+static void
+check_hole(unsigned int win)
+{
+	struct rx_window w = { 0 };
+	uint32_t done[RXWIN_MAX];
+	uint16_t nb_done;
+
+	CHECK(rxwin_mark(&w, 1, win - 1, win) == 0);
+	CHECK(rxwin_advance(&w, done, &nb_done, win) == (uint32_t)-1);
+	CHECK(w.head == 0);
+	CHECK(rxwin_mark(&w, 0, 1, win) == 0);
+	CHECK(w.acked == rxwin_bits(win));
+	CHECK(rxwin_advance(&w, done, &nb_done, win) == win - 1);
+	CHECK(w.head == (int)win && w.acked == 0);
+}
+
+/* below head and past the window is counted, the rest still marked */
+static void
+check_out_of_window(unsigned int win)
+{
+	struct rx_window w = { 0 };
+	uint32_t done[RXWIN_MAX];
+	uint16_t nb_done;
+
+	w.head = 5;
+	CHECK(rxwin_mark(&w, 0, 3, win) == 3);
+	CHECK(w.acked == 0);
+	CHECK(rxwin_mark(&w, 3, 4, win) == 2);
+	CHECK(w.acked == 3);
+	CHECK(rxwin_mark(&w, 5 + win - 1, 3, win) == 2);
+	CHECK(w.acked == (3 | 1ULL << (win - 1)));
+	CHECK(rxwin_mark(&w, 5 + win, 1, win) == 1);
+	CHECK(rxwin_advance(&w, done, &nb_done, win) == 6);
+}
+
+static void
+check_psh(unsigned int win)
+{
+	struct rx_window w = { 0 };
+	uint32_t done[RXWIN_MAX];
+	uint16_t nb_done;
+
+	rxwin_mark(&w, 0, 5, win);
+	rxwin_psh(&w, 1, win);
+	rxwin_psh(&w, 4, win);
+	rxwin_psh(&w, win, win); // outside, dropped
+	rxwin_mark(&w, 6, 1, win);
+	rxwin_psh(&w, 6, win);
+	CHECK(rxwin_advance(&w, done, &nb_done, win) == 4);
+	CHECK(nb_done == 2 && done[0] == 1 && done[1] == 4);
+	CHECK(w.psh == 2); // seq 6, now one past head
+	rxwin_mark(&w, 5, 1, win);
+	CHECK(rxwin_advance(&w, done, &nb_done, win) == 6);
+	CHECK(nb_done == 1 && done[0] == 6);
+}
+
+static void
+check_gro(void)
+{
+	struct rte_mbuf mbufs[8];
+	struct rte_mbuf *bufs[8], *merged[8];
+	struct seg_desc desc[8];
+	uint16_t nb, nb_merged;
+	int k;
+
+	memset(desc, 0, sizeof(desc));
+	for (k = 0; k < 8; k++) {
+		bufs[k] = &mbufs[k];
+		desc[k].flow_id = k < 5 ? 1 : 2;
+		desc[k].seq = k < 5 ? k : k - 5;
+		desc[k].nseg = 1;
+		desc[k].tsval = 100 + k;
+		desc[k].ect = 1;
+	}
+	desc[2].seq = 7; // a hole between 1 and 7
+	desc[3].seq = 8;
+	desc[3].flags = RTE_TCP_PSH_FLAG; // nothing joins past it
+	desc[4].seq = 9;
+	desc[6].ce = 1;
+	desc[7].flow_id = -1; // not ours, never merged
+	desc[7].seq = 2;
+
+	nb = gro_burst(bufs, desc, 8, merged, &nb_merged);
+	CHECK(nb == 5);
+	CHECK(nb_merged == 3);
+	CHECK(desc[0].flow_id == 1 && desc[0].seq == 0 && desc[0].nseg == 2 && desc[0].tsval == 101);
+	CHECK(desc[1].seq == 7 && desc[1].nseg == 2 && (desc[1].flags & RTE_TCP_PSH_FLAG));
+	CHECK(desc[2].seq == 9 && desc[2].nseg == 1);
+	CHECK(desc[3].flow_id == 2 && desc[3].nseg == 2 && desc[3].ect == 2 && desc[3].ce == 1);
+	CHECK(desc[4].flow_id == -1);
+	CHECK(bufs[0] == &mbufs[0] && bufs[1] == &mbufs[2] && bufs[2] == &mbufs[4] &&
+	      bufs[3] == &mbufs[5] && bufs[4] == &mbufs[7]);
+	CHECK(merged[0] == &mbufs[1] && merged[1] == &mbufs[3] && merged[2] == &mbufs[6]);
+}
+
+int
+main(void)
+{
+	static const unsigned int wins[] = { 10, 32, 63, 64 };
+	unsigned int i;
+
+	for (i = 0; i < RTE_DIM(wins); i++) {
+		check_in_order(wins[i]);
+		check_hole(wins[i]);
+		check_out_of_window(wins[i]);
+		check_psh(wins[i]);
+	}
+	check_gro();
+	return check_result("test-rxwin");
+}